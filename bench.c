@@ -0,0 +1,221 @@
+#include "jdtalk.h"
+
+// Names of the phases of a run (indexed by BENCH_*)
+static const char *bench_phase_name[BENCH_PHASES] = {
+    "load",
+    "index",
+    "generate",
+    "transform",
+    "output",
+};
+
+/**
+ * Read the monotonic clock
+ * @return nanoseconds since an arbitrary point in the past
+ */
+uint64_t bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Initialize measurements
+ * @param bench pointer to measurements
+ */
+void bench_init(struct Bench *bench) {
+    memset(bench, 0, sizeof(*bench));
+}
+
+/**
+ * Get the latency histogram bucket of a duration
+ *
+ * Durations below BENCH_SUB_BUCKETS nanoseconds have a bucket each. Each
+ * power of two above that is split into BENCH_SUB_BUCKETS buckets, so a
+ * bucket is never wider than 1/16 of the durations it holds.
+ *
+ * @param ns duration in nanoseconds
+ * @return bucket
+ */
+static size_t bench_bucket(uint64_t ns) {
+    unsigned msb;
+
+    if (ns < BENCH_SUB_BUCKETS) {
+        return (size_t) ns;
+    }
+    msb = 63 - (unsigned) __builtin_clzll(ns);
+    return (size_t) (msb - 3) * BENCH_SUB_BUCKETS + (size_t) ((ns >> (msb - 4)) & (BENCH_SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the smallest duration of a latency histogram bucket
+ * @param bucket bucket (see bench_bucket)
+ * @return duration in nanoseconds
+ */
+static uint64_t bench_bucket_floor(size_t bucket) {
+    unsigned msb;
+
+    if (bucket < BENCH_SUB_BUCKETS) {
+        return bucket;
+    }
+    msb = (unsigned) (bucket / BENCH_SUB_BUCKETS) + 3;
+    return (uint64_t) (BENCH_SUB_BUCKETS + bucket % BENCH_SUB_BUCKETS) << (msb - 4);
+}
+
+/**
+ * Record the latency of a line
+ * @param bench pointer to measurements
+ * @param ns time taken to produce the line in nanoseconds
+ */
+void bench_latency(struct Bench *bench, uint64_t ns) {
+    bench->latency[bench_bucket(ns)]++;
+}
+
+/**
+ * Get a percentile of the line latencies
+ * @param bench pointer to measurements
+ * @param percentile percentile (0-100)
+ * @return latency in nanoseconds (0=no lines)
+ */
+uint64_t bench_percentile(const struct Bench *bench, double percentile) {
+    uint64_t total = 0;
+    uint64_t rank;
+    uint64_t seen;
+
+    for (size_t i = 0; i < BENCH_BUCKETS; i++) {
+        total += bench->latency[i];
+    }
+    if (!total) {
+        return 0;
+    }
+    rank = (uint64_t) ((double) total * percentile / 100.0 + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    seen = 0;
+    for (size_t i = 0; i < BENCH_BUCKETS; i++) {
+        seen += bench->latency[i];
+        if (seen >= rank) {
+            return bench_bucket_floor(i);
+        }
+    }
+    return bench_bucket_floor(BENCH_BUCKETS - 1);
+}
+
+/**
+ * Add the measurements of one thread to another
+ * @param dest pointer to measurements receiving the sums
+ * @param src pointer to measurements to add
+ */
+void bench_merge(struct Bench *dest, const struct Bench *src) {
+    for (size_t i = 0; i < BENCH_PHASES; i++) {
+        dest->phase[i] += src->phase[i];
+    }
+    dest->lines += src->lines;
+    dest->bytes += src->bytes;
+    dest->rejected += src->rejected;
+    dest->redrawn += src->redrawn;
+    for (size_t i = 0; i < BENCH_BUCKETS; i++) {
+        dest->latency[i] += src->latency[i];
+    }
+}
+
+/**
+ * Get the name of the generator mode of a run
+ * @param opt pointer to options
+ * @return name
+ */
+static const char *bench_mode(const struct Options *opt) {
+    if (opt->do_salad) {
+        return "salad";
+    }
+    if (opt->do_heart) {
+        return "heart";
+    }
+    if (opt->do_acronym) {
+        return "acronym";
+    }
+    return "format";
+}
+
+/**
+ * Divide a count by a duration
+ * @param count number of things
+ * @param ns duration in nanoseconds
+ * @return things per second (0=no time elapsed)
+ */
+static double bench_rate(uint64_t count, uint64_t ns) {
+    return ns ? (double) count * 1e9 / (double) ns : 0;
+}
+
+/**
+ * Write a benchmark report
+ *
+ * Phase times of multi-threaded runs are summed across the workers, so
+ * they may add up to more than the time of the run.
+ *
+ * @param bench pointer to measurements
+ * @param opt pointer to options of the run
+ * @param out pointer to output stream receiving the report
+ * @param json 0=text, 1=JSON
+ */
+void bench_report(const struct Bench *bench, const struct Options *opt, struct Output *out, int json) {
+    double total = (double) bench->total / 1e9;
+    double run = (double) bench->run / 1e9;
+    uint64_t p50 = bench_percentile(bench, 50);
+    uint64_t p99 = bench_percentile(bench, 99);
+    // Without worker threads the calling thread generates
+    size_t threads = opt->threads ? opt->threads : 1;
+
+    if (json) {
+        struct Json doc;
+        const char *mode = bench_mode(opt);
+
+        json_init(&doc, out, 1);
+        json_object_begin(&doc);
+        json_key(&doc, "total");
+        json_double(&doc, total, 9);
+        json_key(&doc, "run");
+        json_double(&doc, run, 9);
+        json_key(&doc, "phases");
+        json_object_begin(&doc);
+        for (size_t i = 0; i < BENCH_PHASES; i++) {
+            json_key(&doc, bench_phase_name[i]);
+            json_double(&doc, (double) bench->phase[i] / 1e9, 9);
+        }
+        json_object_end(&doc);
+        json_key(&doc, "threads");
+        json_uint(&doc, threads);
+        json_key(&doc, "mode");
+        json_string(&doc, mode, strlen(mode));
+        json_key(&doc, "lines");
+        json_uint(&doc, bench->lines);
+        json_key(&doc, "bytes");
+        json_uint(&doc, bench->bytes);
+        json_key(&doc, "lines_per_second");
+        json_double(&doc, bench_rate(bench->lines, bench->run), 1);
+        json_key(&doc, "bytes_per_second");
+        json_double(&doc, bench_rate(bench->bytes, bench->run), 1);
+        json_key(&doc, "rejected");
+        json_uint(&doc, bench->rejected);
+        json_key(&doc, "redrawn");
+        json_uint(&doc, bench->redrawn);
+        json_key(&doc, "latency_p50");
+        json_double(&doc, (double) p50 / 1e9, 9);
+        json_key(&doc, "latency_p99");
+        json_double(&doc, (double) p99 / 1e9, 9);
+        json_object_end(&doc);
+        return;
+    }
+
+    output_printf(out, "benchmark: %fs\n", total);
+    for (size_t i = 0; i < BENCH_PHASES; i++) {
+        output_printf(out, "  %-10s %fs\n", bench_phase_name[i], (double) bench->phase[i] / 1e9);
+    }
+    output_printf(out, "  %-10s %fs (%zu threads)\n", "run", run, threads);
+    output_printf(out, "  %-10s %llu (%.1f/s)\n", "lines", (unsigned long long) bench->lines, bench_rate(bench->lines, bench->run));
+    output_printf(out, "  %-10s %llu (%.1f/s)\n", "bytes", (unsigned long long) bench->bytes, bench_rate(bench->bytes, bench->run));
+    output_printf(out, "  %-10s %llu phrases, %llu words (%s mode)\n", "retries",
+                  (unsigned long long) bench->rejected, (unsigned long long) bench->redrawn, bench_mode(opt));
+    output_printf(out, "  %-10s p50 %.3fus, p99 %.3fus\n", "latency", (double) p50 / 1e3, (double) p99 / 1e3);
+}
@@ -0,0 +1,445 @@
+#include <pthread.h>
+#include <sched.h>
+#include "jdtalk.h"
+
+// Ready phrase (owned by whoever claimed its sequence number)
+struct CacheSlot {
+    size_t seq;             // position in the ring the slot is ready for
+    struct StrBuf line;
+};
+
+// Phrase rings of the hot request shapes
+struct Cache {
+    const struct Dictionary *dict;
+    const struct DictionaryView *view;
+    size_t depth;           // phrases per ring (power of two)
+    size_t low;
+    size_t high;
+    pthread_mutex_t lock;   // serializes adding shapes
+    struct CacheShape *shape[CACHE_SHAPES_MAX];
+    size_t nshapes;
+    size_t bypassed;        // requests that found no room for their shape
+};
+
+// Phrases of one request shape, kept filled by a background thread
+struct CacheShape {
+    char *key;              // request shape (see cache_key)
+    struct Request req;     // private copy of the request
+    char *strings;          // storage of the strings of req
+    const struct DictionaryView *view;
+    struct CacheSlot *slot;
+    size_t mask;            // number of slots - 1
+    size_t low;             // refill when fewer phrases are ready
+    size_t high;            // stop refilling once this many phrases are ready
+    // The positions are written by different threads, so each gets its own cache line
+    char pad_head[CACHE_LINE_SIZE];
+    size_t head;            // next position to fill
+    char pad_tail[CACHE_LINE_SIZE];
+    size_t tail;            // next position to take
+    char pad_hits[CACHE_LINE_SIZE];
+    size_t hits;            // lines taken from the ring
+    size_t misses;          // lines generated while the ring was empty
+    int wanted;             // a consumer saw the ring below the low watermark
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t refill;
+    pthread_t thread;
+};
+
+/**
+ * Describe the phrases a request produces
+ *
+ * Requests with the same key draw phrases from the same distribution, no
+ * matter how many lines they ask for or how the lines are written out.
+ *
+ * @param opt pointer to options (after request_prepare)
+ * @param sb string builder receiving the key
+ */
+static void cache_key(const struct Options *opt, struct StrBuf *sb) {
+    strbuf_printf(sb, "%zu:%s %zu:%s %zu:%s %d%d%d%d%d%d %zu %zu %zu %u",
+                  strlen(opt->format), opt->format, strlen(opt->pattern), opt->pattern, strlen(opt->acronym), opt->acronym,
+                  opt->do_pattern, opt->do_exact, opt->do_acronym, opt->do_salad, opt->do_heart, opt->do_format,
+                  opt->salad_limit, opt->heart_limit, opt->heart_maxlen, generate_transforms(opt));
+}
+
+/**
+ * Put a phrase in the ring
+ *
+ * The slot at the head is also unavailable while a consumer that already
+ * claimed it is still copying its phrase out (see cache_take).
+ *
+ * @param shape pointer to shape
+ * @param line phrase
+ * @param len length of phrase
+ * @return 0=success, -1=the slot at the head isn't free yet
+ */
+static int cache_put(struct CacheShape *shape, const char *line, size_t len) {
+    struct CacheSlot *slot;
+    size_t pos;
+
+    pos = __atomic_load_n(&shape->head, __ATOMIC_RELAXED);
+    while (1) {
+        intptr_t diff;
+
+        slot = &shape->slot[pos & shape->mask];
+        diff = (intptr_t) __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (intptr_t) pos;
+        if (diff < 0) {
+            return -1;
+        }
+        if (!diff) {
+            if (__atomic_compare_exchange_n(&shape->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else {
+            pos = __atomic_load_n(&shape->head, __ATOMIC_RELAXED);
+        }
+    }
+    strbuf_clear(&slot->line);
+    strbuf_append(&slot->line, line, len);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Count the phrases ready in the ring
+ * @param shape pointer to shape
+ * @return number of phrases (approximate while the ring is in use)
+ */
+static size_t cache_fill(struct CacheShape *shape) {
+    size_t tail = __atomic_load_n(&shape->tail, __ATOMIC_ACQUIRE);
+    size_t head = __atomic_load_n(&shape->head, __ATOMIC_ACQUIRE);
+    return head > tail ? head - tail : 0;
+}
+
+/**
+ * Keep the ring of a shape filled
+ *
+ * The ring is topped up to the high watermark whenever it falls below the
+ * low watermark.
+ *
+ * @param arg pointer to CacheShape
+ * @return NULL
+ */
+static void *cache_worker(void *arg) {
+    struct CacheShape *shape = arg;
+    const struct Options *opt = &shape->req.opt;
+    struct GenerateBatch batch;
+    struct Talk ctx;
+    struct Rng rng;
+
+    rng_seed(&rng, opt->seed);
+    talk_init(&ctx, shape->view, &rng);
+    ctx.plant = shape->req.plant_ptr;
+    generate_batch_init(&batch, opt);
+
+    while (1) {
+        size_t fill;
+
+        pthread_mutex_lock(&shape->lock);
+        while (!shape->stopping && !shape->wanted && cache_fill(shape) >= shape->low) {
+            pthread_cond_wait(&shape->refill, &shape->lock);
+        }
+        __atomic_store_n(&shape->wanted, 0, __ATOMIC_RELAXED);
+        if (shape->stopping) {
+            pthread_mutex_unlock(&shape->lock);
+            break;
+        }
+        pthread_mutex_unlock(&shape->lock);
+
+        while ((fill = cache_fill(shape)) < shape->high) {
+            size_t nlines = shape->high - fill;
+            const char *line;
+
+            if (nlines > GENERATE_CHUNK_LINES) {
+                nlines = GENERATE_CHUNK_LINES;
+            }
+            generate_chunk(&ctx, opt, &batch, nlines);
+            line = batch.chunk.data;
+            for (size_t i = 0; i < nlines; ) {
+                const char *end = strchr(line, '\n');
+                if (cache_put(shape, line, (size_t) (end - line)) < 0) {
+                    if (cache_fill(shape) >= shape->high || __atomic_load_n(&shape->stopping, __ATOMIC_RELAXED)) {
+                        break;
+                    }
+                    // A consumer is still taking the phrase out of the slot, keep this one for it
+                    sched_yield();
+                    continue;
+                }
+                line = end + 1;
+                i++;
+            }
+        }
+    }
+
+    generate_batch_free(&batch);
+    return NULL;
+}
+
+/**
+ * Create a phrase cache
+ *
+ * The depth is rounded up to a power of two. Watermarks of 0 select a
+ * quarter of the depth (low) and the whole depth (high).
+ *
+ * @param depth number of phrases kept per request shape (0=disable the cache)
+ * @param low refill a ring when fewer phrases are ready
+ * @param high stop refilling a ring once this many phrases are ready
+ * @param dict pointer to indexed dictionary
+ * @param view array of dictionary views (indexed by word type)
+ * @return pointer to cache (release with cache_free), or NULL if the watermarks are invalid
+ */
+struct Cache *cache_new(size_t depth, size_t low, size_t high, const struct Dictionary *dict, const struct DictionaryView *view) {
+    struct Cache *cache;
+    size_t size;
+
+    for (size = 1; size < depth; size *= 2) {
+        continue;
+    }
+    if (depth) {
+        low = low ? low : size > 4 ? size / 4 : 1;
+        high = high ? high : size;
+        if (high > size || low > high) {
+            return NULL;
+        }
+    }
+
+    cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        perror("Unable to allocate cache");
+        exit(1);
+    }
+    cache->dict = dict;
+    cache->view = view;
+    cache->depth = depth ? size : 0;
+    cache->low = low;
+    cache->high = high;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+/**
+ * Create a shape and start refilling its ring
+ * @param cache pointer to cache
+ * @param req pointer to request (after request_prepare)
+ * @param key request shape
+ * @return pointer to shape, or NULL on failure
+ */
+static struct CacheShape *cache_shape_new(struct Cache *cache, const struct Request *req, const char *key) {
+    const struct Options *opt = &req->opt;
+    struct CacheShape *shape;
+    struct StrBuf errbuf;
+    size_t nformat = strlen(opt->format) + 1;
+    size_t npattern = strlen(opt->pattern) + 1;
+    size_t nacronym = strlen(opt->acronym) + 1;
+
+    shape = calloc(1, sizeof(*shape));
+    if (!shape) {
+        perror("Unable to allocate cache shape");
+        exit(1);
+    }
+    shape->key = strdup(key);
+    shape->strings = malloc(nformat + npattern + nacronym);
+    shape->slot = calloc(cache->depth, sizeof(*shape->slot));
+    if (!shape->key || !shape->strings || !shape->slot) {
+        perror("Unable to allocate cache shape");
+        exit(1);
+    }
+
+    // The request of the client goes away, so the shape keeps its own copy
+    request_init(&shape->req);
+    shape->req.opt = *opt;
+    shape->req.opt.format = memcpy(shape->strings, opt->format, nformat);
+    shape->req.opt.pattern = memcpy(shape->strings + nformat, opt->pattern, npattern);
+    shape->req.opt.acronym = memcpy(shape->strings + nformat + npattern, opt->acronym, nacronym);
+    shape->req.opt.plan = NULL;
+    shape->req.opt.seed = rng_seed_default() ^ ((uint64_t) cache->nshapes * 0x9e3779b97f4a7c15ULL);
+    strbuf_new(&errbuf, 0);
+    if (request_prepare(&shape->req, cache->dict, cache->view, &errbuf) < 0) {
+        strbuf_free(&errbuf);
+        request_free(&shape->req);
+        free(shape->slot);
+        free(shape->strings);
+        free(shape->key);
+        free(shape);
+        return NULL;
+    }
+    strbuf_free(&errbuf);
+
+    shape->view = cache->view;
+    shape->mask = cache->depth - 1;
+    shape->low = cache->low;
+    shape->high = cache->high;
+    for (size_t i = 0; i < cache->depth; i++) {
+        shape->slot[i].seq = i;
+        strbuf_new(&shape->slot[i].line, 0);
+    }
+    // Fill the ring before the first request arrives for it
+    shape->wanted = 1;
+    pthread_mutex_init(&shape->lock, NULL);
+    pthread_cond_init(&shape->refill, NULL);
+    if (pthread_create(&shape->thread, NULL, cache_worker, shape) != 0) {
+        pthread_cond_destroy(&shape->refill);
+        pthread_mutex_destroy(&shape->lock);
+        for (size_t i = 0; i < cache->depth; i++) {
+            strbuf_free(&shape->slot[i].line);
+        }
+        request_free(&shape->req);
+        free(shape->slot);
+        free(shape->strings);
+        free(shape->key);
+        free(shape);
+        return NULL;
+    }
+    return shape;
+}
+
+/**
+ * Find the ring holding the phrases of a request
+ *
+ * The first CACHE_SHAPES_MAX shapes requested get a ring. Requests with a
+ * seed must produce their own phrases, and cached phrases don't keep the
+ * words they are made of (--parts), so neither kind uses the cache.
+ *
+ * @param cache pointer to cache
+ * @param req pointer to request (after request_prepare)
+ * @return pointer to shape, or NULL if the request isn't cached
+ */
+struct CacheShape *cache_find(struct Cache *cache, const struct Request *req) {
+    struct CacheShape *shape = NULL;
+    struct StrBuf key;
+    size_t nshapes;
+
+    if (!cache->depth || req->opt.do_seed || req->opt.do_parts) {
+        return NULL;
+    }
+
+    strbuf_new(&key, 0);
+    cache_key(&req->opt, &key);
+    nshapes = __atomic_load_n(&cache->nshapes, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < nshapes; i++) {
+        if (strcmp(cache->shape[i]->key, key.data) == 0) {
+            shape = cache->shape[i];
+            break;
+        }
+    }
+
+    if (!shape) {
+        pthread_mutex_lock(&cache->lock);
+        // Another worker may have added it meanwhile
+        for (size_t i = nshapes; i < cache->nshapes; i++) {
+            if (strcmp(cache->shape[i]->key, key.data) == 0) {
+                shape = cache->shape[i];
+                break;
+            }
+        }
+        if (!shape && cache->nshapes < CACHE_SHAPES_MAX) {
+            shape = cache_shape_new(cache, req, key.data);
+            if (shape) {
+                cache->shape[cache->nshapes] = shape;
+                __atomic_store_n(&cache->nshapes, cache->nshapes + 1, __ATOMIC_RELEASE);
+            }
+        }
+        if (!shape) {
+            cache->bypassed++;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+    strbuf_free(&key);
+    return shape;
+}
+
+/**
+ * Take a phrase from the ring of a shape
+ *
+ * Wakes the refill thread when the ring falls below the low watermark.
+ *
+ * @param shape pointer to shape
+ * @param out string builder receiving the phrase (appended)
+ * @return 0=hit, -1=miss (the ring is empty)
+ */
+int cache_take(struct CacheShape *shape, struct StrBuf *out) {
+    struct CacheSlot *slot;
+    size_t pos;
+    int result = 0;
+
+    pos = __atomic_load_n(&shape->tail, __ATOMIC_RELAXED);
+    while (1) {
+        intptr_t diff;
+
+        slot = &shape->slot[pos & shape->mask];
+        diff = (intptr_t) __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (intptr_t) (pos + 1);
+        if (diff < 0) {
+            result = -1;
+            break;
+        }
+        if (!diff) {
+            if (__atomic_compare_exchange_n(&shape->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else {
+            pos = __atomic_load_n(&shape->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (!result) {
+        strbuf_append(out, slot->line.data, slot->line.len);
+        __atomic_store_n(&slot->seq, pos + shape->mask + 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&shape->hits, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&shape->misses, 1, __ATOMIC_RELAXED);
+    }
+
+    if (cache_fill(shape) < shape->low && !__atomic_load_n(&shape->wanted, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&shape->lock);
+        __atomic_store_n(&shape->wanted, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&shape->refill);
+        pthread_mutex_unlock(&shape->lock);
+    }
+    return result;
+}
+
+/**
+ * Describe the state of a cache
+ * @param cache pointer to cache
+ * @param sb string builder receiving one line per shape
+ */
+void cache_stats(struct Cache *cache, struct StrBuf *sb) {
+    size_t nshapes = __atomic_load_n(&cache->nshapes, __ATOMIC_ACQUIRE);
+
+    strbuf_printf(sb, "cache: depth %zu, low %zu, high %zu, shapes %zu, bypassed %zu\n",
+                  cache->depth, cache->low, cache->high, nshapes, __atomic_load_n(&cache->bypassed, __ATOMIC_RELAXED));
+    for (size_t i = 0; i < nshapes; i++) {
+        struct CacheShape *shape = cache->shape[i];
+        strbuf_printf(sb, "cache: shape %zu: ready %zu, hits %zu, misses %zu, key %s\n", i, cache_fill(shape),
+                      __atomic_load_n(&shape->hits, __ATOMIC_RELAXED), __atomic_load_n(&shape->misses, __ATOMIC_RELAXED), shape->key);
+    }
+}
+
+/**
+ * Stop the refill threads and release a cache
+ * @param cache pointer to cache
+ */
+void cache_free(struct Cache *cache) {
+    for (size_t i = 0; i < cache->nshapes; i++) {
+        struct CacheShape *shape = cache->shape[i];
+
+        pthread_mutex_lock(&shape->lock);
+        shape->stopping = 1;
+        pthread_cond_signal(&shape->refill);
+        pthread_mutex_unlock(&shape->lock);
+        pthread_join(shape->thread, NULL);
+
+        pthread_cond_destroy(&shape->refill);
+        pthread_mutex_destroy(&shape->lock);
+        for (size_t j = 0; j <= shape->mask; j++) {
+            strbuf_free(&shape->slot[j].line);
+        }
+        request_free(&shape->req);
+        free(shape->slot);
+        free(shape->strings);
+        free(shape->key);
+        free(shape);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
@@ -1,207 +1,488 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "jdtalk.h"
 
+// Words of one raw dictionary file (see dictionary_read_part)
+struct DictionaryPart {
+    char filename[PATH_MAX];
+    unsigned type;
+    char *arena;            // NUL terminated words, back to back
+    size_t arena_inuse;
+    uint32_t *offset;       // offset of each word in arena
+    uint32_t *nchar;        // length of each word
+    size_t nelem_alloc;
+    size_t nelem_inuse;
+    size_t truncated;       // lines cut down to DICT_WORD_LEN_MAX characters
+    int error;              // errno of a failed read (0=success)
+};
+
 /**
- * Initializes a dictionary
- * @return Empty initialized Dictionary structure
+ * Get a view of the words of a single type
+ *
+ * Words of each type are stored contiguously, so the view shares the
+ * dictionary's storage and costs nothing to create.
+ *
+ * @param dict pointer to populated dictionary
+ * @param type type of word (WT_NOUN, WT_VERB, WT_ADVERB, WT_ADJECTIVE), or WT_ANY for all words
+ * @return view of words
  */
-struct Dictionary *dictionary_new() {
-    struct Dictionary *dict;
+struct DictionaryView dictionary_view(const struct Dictionary *dict, unsigned type) {
+    struct DictionaryView view;
+    view.dict = dict;
+    view.base = dict->range[type].base;
+    view.count = dict->range[type].count;
+    view.type = type;
+    return view;
+}
 
-    dict = malloc(1 * sizeof(*dict));
-    if (!dict) {
-        perror("Unable to initialize new dictionary");
-        exit(1);
-    }
-    dict->words = malloc(DICT_INITIAL_SIZE * sizeof(**dict->words));
-    if (!dict->words) {
-        perror("Unable to initialize array of dictionary words");
+const char *dictionary_files[] = {
+        "nouns.txt",
+        "adjectives.txt",
+        "adverbs.txt",
+        "verbs.txt",
+        NULL,
+};
+
+// Types of words expected by dictionary_files[] array
+const unsigned dictionary_files_type[] = {
+        WT_NOUN,
+        WT_ADJECTIVE,
+        WT_ADVERB,
+        WT_VERB,
+};
+
+/**
+ * Get the path to the raw dictionary files
+ *
+ * @return value of JDTALK_DATA
+ */
+const char *dictionary_datadir() {
+    char *datadir;
+    datadir = getenv("JDTALK_DATA");
+    if (!datadir) {
+        fprintf(stderr, "JDTALK_DATA environment variable is not set\n");
         exit(1);
     }
-    dict->nelem_alloc = DICT_INITIAL_SIZE;
-    dict->nelem_inuse = 0;
-    return dict;
+    return datadir;
 }
 
-void dictionary_grow_as_needed(struct Dictionary **dict) {
-    if ((*dict)->nelem_inuse + 1 > (*dict)->nelem_alloc) {
-        struct Word **tmp;
-        (*dict)->nelem_alloc += DICT_INITIAL_SIZE;
-        tmp = realloc((*dict)->words, (*dict)->nelem_alloc * sizeof((*dict)->words));
-        if (!tmp) {
-            perror("Unable to extend word list");
-            exit(1);
+/**
+ * Record the size and modification time of each raw dictionary file
+ *
+ * @param datadir path to raw dictionary files
+ * @param sources array of DICT_SOURCE_MAX records to populate
+ * @return 0=success, -1=a file could not be inspected
+ */
+int dictionary_sources(const char *datadir, struct DictionarySource sources[]) {
+    memset(sources, 0, DICT_SOURCE_MAX * sizeof(*sources));
+    for (size_t i = 0; dictionary_files[i] != NULL; i++) {
+        char filename[PATH_MAX];
+        struct stat st;
+
+        snprintf(filename, sizeof(filename), "%s/%s", datadir, dictionary_files[i]);
+        if (stat(filename, &st) < 0) {
+            return -1;
         }
-        (*dict)->words = tmp;
+        sources[i].size = (uint64_t) st.st_size;
+        sources[i].mtime_sec = (int64_t) st.st_mtim.tv_sec;
+        sources[i].mtime_nsec = (int64_t) st.st_mtim.tv_nsec;
     }
+    return 0;
 }
 
-void dictionary_alloc_word_record(struct Dictionary **dict) {
-    (*dict)->words[(*dict)->nelem_inuse] = malloc(1 * sizeof(**(*dict)->words));
-    if (!(*dict)->words[(*dict)->nelem_inuse]) {
-        perror("Unable to allocate dictionary word list record");
-        exit(1);
-    }
-}
+/**
+ * Split a raw dictionary file into words
+ *
+ * Lines are found with memchr, which scans a vector of bytes at a time,
+ * and copied straight into the arena of the part. Blank lines are skipped,
+ * lines longer than DICT_WORD_LEN_MAX are cut down to that many characters
+ * (counted in part->truncated), and the last line needs no newline.
+ *
+ * @param part pointer to part receiving the words
+ * @param data contents of file
+ * @param size size of file in bytes
+ */
+static void dictionary_split(struct DictionaryPart *part, const char *data, size_t size) {
+    const char *end = data + size;
 
-void dictionary_new_word(struct Dictionary **dict, char *s, unsigned type) {
-    (*dict)->words[(*dict)->nelem_inuse]->word = strdup(s);
-    if (!(*dict)->words[(*dict)->nelem_inuse]->word) {
-        perror("Unable to allocate dictionary word in list");
+    // Every word is at most as long as its line, newline included
+    part->arena = malloc(size + 1);
+    part->nelem_alloc = DICT_INITIAL_SIZE;
+    part->offset = malloc(part->nelem_alloc * sizeof(*part->offset));
+    part->nchar = malloc(part->nelem_alloc * sizeof(*part->nchar));
+    if (!part->arena || !part->offset || !part->nchar) {
+        perror("Unable to allocate dictionary words");
         exit(1);
     }
-    (*dict)->words[(*dict)->nelem_inuse]->nchar = strlen(s) - 1;
-    *((*dict)->words[(*dict)->nelem_inuse]->word + ((*dict)->words[(*dict)->nelem_inuse]->nchar)) = '\0';
-    (*dict)->words[(*dict)->nelem_inuse]->type = type;
-}
 
-struct Dictionary *dictionary_of(struct Dictionary **src, unsigned type) {
-    struct Dictionary *dest;
-    dest = dictionary_new();
-    dictionary_grow_as_needed(&dest);
-    for (size_t i = 0, x = 0; i < (*src)->nelem_inuse; i++) {
-        if ((*src)->words[i]->type != type)
-            continue;
-        dictionary_alloc_word_record(&dest);
-        dest->words[x] = malloc(sizeof(**(*src)->words));
-        dest->words[x] = (*src)->words[i];
-        dest->nelem_inuse++;
-        x++;
+    for (const char *s = data; s < end; ) {
+        const char *eol = memchr(s, '\n', (size_t) (end - s));
+        size_t len = (size_t) ((eol ? eol : end) - s);
+        size_t nchar = len;
+
+        if (nchar > DICT_WORD_LEN_MAX) {
+            nchar = DICT_WORD_LEN_MAX;
+            part->truncated++;
+        }
+        if (nchar) {
+            if (part->nelem_inuse == part->nelem_alloc) {
+                uint32_t *offset;
+                uint32_t *length;
+
+                part->nelem_alloc *= 2;
+                offset = realloc(part->offset, part->nelem_alloc * sizeof(*part->offset));
+                length = offset ? realloc(part->nchar, part->nelem_alloc * sizeof(*part->nchar)) : NULL;
+                if (!offset || !length) {
+                    perror("Unable to extend word list");
+                    exit(1);
+                }
+                part->offset = offset;
+                part->nchar = length;
+            }
+            part->offset[part->nelem_inuse] = (uint32_t) part->arena_inuse;
+            part->nchar[part->nelem_inuse] = (uint32_t) nchar;
+            part->nelem_inuse++;
+            memcpy(part->arena + part->arena_inuse, s, nchar);
+            part->arena[part->arena_inuse + nchar] = '\0';
+            part->arena_inuse += nchar + 1;
+        }
+        s += len + 1;
     }
-    return dest;
 }
 
 /**
- * Add a word to the dictionary
- *
- * @param dict pointer to dictionary
- * @param s string to append to word list
- * @param type type of word (WT_NOUN, WT_VERB, WT_ADVERB, WT_ADJECTIVE)
+ * Read the words of a raw dictionary file (thread entry point)
+ * @param arg pointer to part (filename and type are set)
+ * @return NULL
  */
-void dictionary_append(struct Dictionary **dict, char *s, unsigned type) {
-    dictionary_grow_as_needed(dict);
-    dictionary_alloc_word_record(dict);
-    dictionary_new_word(dict, s, type);
-    (*dict)->nelem_inuse++;
+static void *dictionary_read_part(void *arg) {
+    struct DictionaryPart *part = arg;
+    struct stat st;
+    void *data;
+    int fd;
+
+    fd = open(part->filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        part->error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    data = NULL;
+    if (st.st_size > 0) {
+        data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            part->error = errno;
+            close(fd);
+            return NULL;
+        }
+        madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    dictionary_split(part, data, (size_t) st.st_size);
+    if (data) {
+        munmap(data, (size_t) st.st_size);
+    }
+    return NULL;
 }
 
 /**
- * Extract words from a file and append them to a Dictionary
- * structure with a specific type
+ * Consume raw dictionary files
  *
- * @param fp raw dictionary file handle
- * @param dict pointer to Dictionary structure
- * @param type type of words in raw dictionary file
- * @return 0=success or value of errno on failure
+ * Each file is read by a thread of its own. The words are then joined in
+ * the order of dictionary_files[], so the words of each type stay
+ * contiguous and every run stores them the same way.
+ *
+ * @param datadir path to raw dictionary files
+ * @param types bitmask of word types to read (1 << WT_*, see DICT_TYPES_ALL)
+ * @return dictionary populated with words of the requested types
  */
-int dictionary_read(FILE *fp, struct Dictionary **dict, unsigned type) {
-    char *buf;
+struct Dictionary *dictionary_populate_text(const char *datadir, unsigned types) {
+    struct DictionaryPart part[DICT_SOURCE_MAX];
+    pthread_t thread[DICT_SOURCE_MAX];
+    int started[DICT_SOURCE_MAX];
+    struct Dictionary *dict;
+    size_t nparts;
+    size_t nelem;
+    size_t arena_size;
+
+    memset(part, 0, sizeof(part));
+    memset(started, 0, sizeof(started));
+    nparts = 0;
+    for (size_t i = 0; dictionary_files[i] != NULL; i++) {
+        if (!(types & (1U << dictionary_files_type[i]))) {
+            // Not needed: skip the I/O and the memory of the whole file
+            continue;
+        }
+        snprintf(part[nparts].filename, sizeof(part[nparts].filename), "%s/%s", datadir, dictionary_files[i]);
+        part[nparts].type = dictionary_files_type[i];
+        nparts++;
+    }
 
-    buf = malloc(DICT_WORD_SIZE_MAX * sizeof(char));
-    if (!buf) {
-        perror("Unable to allocate buffer for dictionary_read");
+    // The calling thread reads the last file itself
+    for (size_t i = 0; i + 1 < nparts; i++) {
+        started[i] = pthread_create(&thread[i], NULL, dictionary_read_part, &part[i]) == 0;
+    }
+    for (size_t i = 0; i < nparts; i++) {
+        if (!started[i]) {
+            dictionary_read_part(&part[i]);
+        }
+    }
+    for (size_t i = 0; i < nparts; i++) {
+        if (started[i]) {
+            pthread_join(thread[i], NULL);
+        }
+    }
+
+    nelem = 0;
+    arena_size = 0;
+    for (size_t i = 0; i < nparts; i++) {
+        if (part[i].error) {
+            fprintf(stderr, "Unable to open dictionary: %s: %s\n", part[i].filename, strerror(part[i].error));
+            exit(1);
+        }
+        if (part[i].truncated) {
+            fprintf(stderr, "Truncated %zu words of %s longer than %d characters\n", part[i].truncated, part[i].filename, DICT_WORD_LEN_MAX);
+        }
+        nelem += part[i].nelem_inuse;
+        arena_size += part[i].arena_inuse;
+    }
+    if (arena_size > UINT32_MAX) {
+        fprintf(stderr, "Unable to extend dictionary string arena: too many words\n");
         exit(1);
     }
-    while ((fgets(buf, DICT_WORD_SIZE_MAX - 1, fp) != NULL)) {
-        if (errno) {
-            return errno;
+
+    dict = calloc(1, sizeof(*dict));
+    if (!dict) {
+        perror("Unable to initialize new dictionary");
+        exit(1);
+    }
+    dict->nelem_alloc = nelem ? nelem : 1;
+    dict->arena_alloc = arena_size ? arena_size : 1;
+    dict->offset = malloc(dict->nelem_alloc * sizeof(*dict->offset));
+    dict->nchar = malloc(dict->nelem_alloc * sizeof(*dict->nchar));
+    dict->type = malloc(dict->nelem_alloc * sizeof(*dict->type));
+    dict->arena = malloc(dict->arena_alloc * sizeof(*dict->arena));
+    if (!dict->offset || !dict->nchar || !dict->type || !dict->arena) {
+        perror("Unable to initialize array of dictionary words");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < nparts; i++) {
+        struct DictionaryPart *p = &part[i];
+        struct DictionaryRange *range = &dict->range[p->type];
+
+        range->base = (uint32_t) dict->nelem_inuse;
+        range->count = (uint32_t) p->nelem_inuse;
+        dict->range[WT_ANY].count += range->count;
+        memcpy(dict->arena + dict->arena_inuse, p->arena, p->arena_inuse);
+        for (size_t w = 0; w < p->nelem_inuse; w++) {
+            dict->offset[dict->nelem_inuse + w] = p->offset[w] + (uint32_t) dict->arena_inuse;
         }
-        if (*buf == '\0' || *buf == '\n')
-            continue;
-        dictionary_append(&(*dict), buf, type);
+        memcpy(&dict->nchar[dict->nelem_inuse], p->nchar, p->nelem_inuse * sizeof(*p->nchar));
+        memset(&dict->type[dict->nelem_inuse], (int) p->type, p->nelem_inuse);
+        dict->nelem_inuse += p->nelem_inuse;
+        dict->arena_inuse += p->arena_inuse;
+        free(p->arena);
+        free(p->offset);
+        free(p->nchar);
     }
-    free(buf);
-    return 0;
+    index_build(dict);
+    return dict;
 }
 
 /**
  * Consume all dictionary files
  *
- * @return fully populated dictionary of words
+ * A compiled image (see image_write) is preferred. The raw dictionary
+ * files are used when the image is missing or older than the files it
+ * was compiled from. Programs built with JDTALK_EMBED_DATA use their
+ * built-in dictionary unless JDTALK_DATA is set.
+ *
+ * Images hold every type of word and are paged in on demand. Only raw
+ * dictionary files of the requested types are read.
+ *
+ * @param types bitmask of word types needed (1 << WT_*, see DICT_TYPES_ALL)
+ * @return dictionary populated with (at least) words of the requested types
  */
-struct Dictionary *dictionary_populate() {
-    FILE *fp;
+struct Dictionary *dictionary_populate(unsigned types) {
     struct Dictionary *dict;
-    const char *files[] = {
-            "nouns.txt",
-            "adjectives.txt",
-            "adverbs.txt",
-            "verbs.txt",
-            NULL,
-    };
-
-    // Types of words expected by files[] array
-    const unsigned files_type[] = {
-            WT_NOUN,
-            WT_ADJECTIVE,
-            WT_ADVERB,
-            WT_VERB,
-    };
-
-    // Initialize the dictionary
-    dict = dictionary_new();
-
-    // Consume each dictionary in files[]
-    for (size_t i = 0; files[i] != NULL; i++) {
-        char *datadir;
-        char filename[PATH_MAX];
-        filename[0] = '\0';
-        datadir = getenv("JDTALK_DATA");
+    const char *datadir;
 
-        if (!datadir) {
-            fprintf(stderr, "JDTALK_DATA environment variable is not set\n");
-            exit(1);
+#ifdef JDTALK_EMBED_DATA
+    if (!getenv("JDTALK_DATA")) {
+        dict = image_embedded();
+        if (dict) {
+            return dict;
         }
+    }
+#endif
+    datadir = dictionary_datadir();
+    dict = image_load(datadir, DICT_IMAGE_NAME);
+    if (!dict) {
+        dict = dictionary_populate_text(datadir, types);
+    }
+    return dict;
+}
 
-        sprintf(filename, "%s/%s", datadir, files[i]);
-        fp = fopen(filename, "r");
-        if (!fp) {
-            fprintf(stderr, "Unable to open dictionary: %s", filename);
-            exit(1);
-        }
+/**
+ * Consume all dictionary files, sharing them with other processes
+ *
+ * Like dictionary_populate, but when the raw dictionary files have to be
+ * read, the result is published in shared memory (see image_publish).
+ * Later processes attach to it read-only instead of reading the files, so
+ * concurrent processes share one copy of the words and their indexes.
+ *
+ * @return fully populated dictionary of words
+ */
+struct Dictionary *dictionary_populate_shared() {
+    struct Dictionary *dict;
+    struct Dictionary *shared;
+    const char *datadir;
+
+#ifdef JDTALK_EMBED_DATA
+    if (!getenv("JDTALK_DATA")) {
+        // The built-in dictionary is already shared through the page cache
+        return dictionary_populate(DICT_TYPES_ALL);
+    }
+#endif
+    datadir = dictionary_datadir();
+    dict = image_load(datadir, DICT_IMAGE_NAME);
+    if (dict) {
+        // Already shared through the page cache
+        return dict;
+    }
+    dict = image_attach(datadir);
+    if (dict) {
+        return dict;
+    }
+    if (errno == EPERM) {
+        // Somebody else holds the name, so nothing we publish could be attached to
+        return dictionary_populate_text(datadir, DICT_TYPES_ALL);
+    }
 
-        // Append the contents of file[i] to dictionary
-        dictionary_read(fp, &dict, files_type[i]);
-        fclose(fp);
+    dict = dictionary_populate_text(datadir, DICT_TYPES_ALL);
+    if (image_publish(dict, datadir) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to share dictionary: %s\n", strerror(errno));
+        return dict;
+    }
+    // Trade the private copy for the published one (ours, or that of a process that beat us to it)
+    shared = image_attach(datadir);
+    if (shared) {
+        dictionary_free(dict);
+        dict = shared;
     }
     return dict;
 }
 
+/**
+ * Get the format character of a word type
+ * @param type type of word (WT_NOUN, WT_VERB, WT_ADVERB, WT_ADJECTIVE)
+ * @return format character (i.e. n,a,d,v), or 'x' for anything else
+ */
+char dictionary_type_format(unsigned type) {
+    switch (type) {
+        case WT_NOUN:
+            return 'n';
+        case WT_ADJECTIVE:
+            return 'a';
+        case WT_ADVERB:
+            return 'd';
+        case WT_VERB:
+            return 'v';
+        default:
+            return 'x';
+    }
+}
+
 /**
  * Get the types of a word
  * @param dict pointer to dictionary
  * @param s dictionary word to search for
+ * @param out string builder receiving the word types (i.e. n,a,d,v)
+ * @return number of types appended (0=not found)
+ */
+int dictionary_word_formats_r(const struct Dictionary *dict, const char *s, struct StrBuf *out) {
+    unsigned types;
+    int count;
+
+    types = index_lookup(dict, s, 0);
+    count = 0;
+    for (size_t i = 0; dictionary_files[i] != NULL; i++) {
+        if (types & (1u << dictionary_files_type[i])) {
+            strbuf_putc(out, dictionary_type_format(dictionary_files_type[i]));
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Get the types of a word
+ *
+ * Not reentrant. See dictionary_word_formats_r.
+ *
+ * @param dict pointer to dictionary
+ * @param s dictionary word to search for
  * @return a string containing the word types (i.e. n,a,d,v)
  */
 char *dictionary_word_formats(struct Dictionary *dict, const char *s) {
-    static char buf[OUTPUT_SIZE_MAX];
-    buf[0] = '\0';
+    static char buf[WT_VERB + 1];
+    struct StrBuf sb;
 
-    for (size_t i = 0; i < dict->nelem_inuse; i++) {
-        if (strcmp(dict->words[i]->word, s) != 0) {
-            continue;
+    strbuf_init(&sb, buf, sizeof(buf));
+    if (!dictionary_word_formats_r(dict, s, &sb)) {
+        return NULL;
+    }
+    return buf;
+}
+
+/**
+ * Get the type of a word produced by the generator
+ *
+ * Words drawn from the dictionary point into its arena and have exactly
+ * one type. Other words (planted search patterns) are looked up, and get
+ * the first of their types in dictionary file order.
+ *
+ * @param dict pointer to dictionary
+ * @param word word of a phrase
+ * @return type of word (WT_*), or -1 if it is not a dictionary word
+ */
+int dictionary_word_type(const struct Dictionary *dict, const char *word) {
+    unsigned types;
+
+    if (word >= dict->arena && word < dict->arena + dict->arena_inuse && dict->nelem_inuse) {
+        uint32_t offset = (uint32_t) (word - dict->arena);
+        size_t lo = 0;
+        size_t hi = dict->nelem_inuse;
+
+        // Words are stored in arena order, so offset is sorted
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (dict->offset[mid] <= offset) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
         }
-        switch (dict->words[i]->type) {
-            case WT_NOUN:
-                strcat(buf, "n");
-                break;
-            case WT_ADJECTIVE:
-                strcat(buf, "a");
-                break;
-            case WT_ADVERB:
-                strcat(buf, "d");
-                break;
-            case WT_VERB:
-                strcat(buf, "v");
-                break;
-            default:
-                strcat(buf, "x");
-                break;
+        if (dict->offset[lo] == offset) {
+            return dict->type[lo];
         }
     }
-    if (!strlen(buf)) {
-        return NULL;
+
+    types = index_lookup(dict, word, 0);
+    for (size_t i = 0; dictionary_files[i] != NULL; i++) {
+        if (types & (1u << dictionary_files_type[i])) {
+            return (int) dictionary_files_type[i];
+        }
     }
-    return buf;
+    return -1;
 }
 
 /**
@@ -233,67 +514,115 @@ char *dictionary_word_formats(struct Dictionary *dict, const char *s) {
  * result = dictionary_contains(dict, "Beef", WT_ANY | WT_ICASE);
  * // 1
  *
- * @param dict pointer to populated dictionary
+ * @param dict pointer to populated (master) dictionary
  * @param s pointer to pattern string
  * @param type type of word (WT_NOUN, WT_VERB, WT_ADVERB, WT_ADJECTIVE) || (WT_ANY, WT_ICASE)
  * @return 0=not found, !0=found
  */
-unsigned dictionary_contains(struct Dictionary *dict[], const char *s, unsigned type) {
+unsigned dictionary_contains(const struct Dictionary *dict, const char *s, unsigned type) {
     unsigned result;
-    int found;
+    unsigned types;
     unsigned icase;
 
     icase = type & WT_ICASE; // Determine case-sensitivity of the search function
     type &= 0x7f;  // Strip case-insensitive flag from type
     result = 0;
 
-    for (size_t x = 0; dict[x] != NULL; x++) {
-        found = 0;
-        struct Dictionary *rec = dict[x];
-        for (size_t i = 0; i < rec->nelem_inuse; i++) {
-            if (*s != *rec->words[i]->word) {
-                // Didn't start with first character in s
-                continue;
-            }
-
-            if (type != WT_ANY && rec->words[i]->type != type) {
-                // Incorrect type of word
-                continue;
-            }
-
-            if (icase) {
-                found = strcasecmp(rec->words[i]->word, s) == 0;
-            } else {
-                found = strcmp(rec->words[i]->word, s) == 0;
-            }
-
-            if (found) {
-                result |= (unsigned) rec->words[i]->type;
-                break;
-            }
+    types = index_lookup(dict, s, icase != 0);
+    for (unsigned x = WT_NOUN; x <= WT_VERB; x++) {
+        if (!(types & (1u << x))) {
+            continue;
+        }
+        if (type != WT_ANY && x != type) {
+            // Incorrect type of word
+            continue;
         }
+        result |= x;
     }
     return result;
 }
 
 /**
- * Produce a random word from the dictionary of type
+ * Produce a random word from a dictionary view
  *
- * When type is WT_ANY, a random word irrespective of type will be produced
+ * @param view pointer to dictionary view (must hold words)
+ * @param rng pointer to random number generator
+ * @return pointer to dictionary word
+ */
+char *dictionary_word(const struct DictionaryView *view, struct Rng *rng) {
+    size_t index;
+
+    assert(view->count > 0);
+    index = view->base + rng_bounded(rng, (uint32_t) view->count);
+    return dictionary_at(view->dict, index);
+}
+
+/**
+ * Produce a random word from a dictionary view, and its length
  *
- * @param dict pointer to dictionary
- * @param type type of word to produce
+ * @param view pointer to dictionary view (must hold words)
+ * @param rng pointer to random number generator
+ * @param len receives the length of the word
  * @return pointer to dictionary word
  */
-char *dictionary_word(struct Dictionary *dict, unsigned type) {
-    struct Word *word;
-    while (1) {
-        size_t index = random() % dict->nelem_inuse;
-        word = dict->words[index];
-        if (word->type == type || type == WT_ANY) {
-            return word->word;
-        }
+const char *dictionary_word_len(const struct DictionaryView *view, struct Rng *rng, size_t *len) {
+    size_t index;
+
+    assert(view->count > 0);
+    index = view->base + rng_bounded(rng, (uint32_t) view->count);
+    *len = view->dict->nchar[index];
+    return dictionary_at(view->dict, index);
+}
+
+/**
+ * Produce a random word from a dictionary view beginning with a character
+ *
+ * @param view pointer to dictionary view
+ * @param ch first character
+ * @param rng pointer to random number generator
+ * @return pointer to dictionary word, or NULL if no word begins with ch
+ */
+char *dictionary_word_letter(const struct DictionaryView *view, char ch, struct Rng *rng) {
+    const uint32_t *words;
+    size_t count;
+
+    words = index_letter(view->dict, view->type, ch, &count);
+    if (!count) {
+        return NULL;
+    }
+    return dictionary_at(view->dict, words[rng_bounded(rng, (uint32_t) count)]);
+}
+
+/**
+ * Count the words of a dictionary view no longer than a length
+ *
+ * @param view pointer to dictionary view
+ * @param maxlen maximum length of each word
+ * @return number of words
+ */
+size_t dictionary_count_short(const struct DictionaryView *view, size_t maxlen) {
+    size_t count;
+    index_length(view->dict, view->type, maxlen, &count);
+    return count;
+}
+
+/**
+ * Produce a random word from a dictionary view no longer than a length
+ *
+ * @param view pointer to dictionary view
+ * @param maxlen maximum length of the word
+ * @param rng pointer to random number generator
+ * @return pointer to dictionary word, or NULL if no word is short enough
+ */
+char *dictionary_word_short(const struct DictionaryView *view, size_t maxlen, struct Rng *rng) {
+    const uint32_t *words;
+    size_t count;
+
+    words = index_length(view->dict, view->type, maxlen, &count);
+    if (!count) {
+        return NULL;
     }
+    return dictionary_at(view->dict, words[rng_bounded(rng, (uint32_t) count)]);
 }
 
 /**
@@ -301,11 +630,16 @@ char *dictionary_word(struct Dictionary *dict, unsigned type) {
  * @param dict pointer to dictionary
  */
 void dictionary_free(struct Dictionary *dict) {
-    for (size_t i = 0; i < dict->nelem_inuse; i++) {
-        free(dict->words[i]->word);
-        free(dict->words[i]);
+    if (dict->image) {
+        // Words and tables live inside the image
+        image_unmap(dict);
+        free(dict);
+        return;
     }
-    free(dict->words);
+    free(dict->arena);
+    index_free(dict);
+    free(dict->offset);
+    free(dict->nchar);
+    free(dict->type);
     free(dict);
 }
-
@@ -0,0 +1,22 @@
+#include "jdtalk.h"
+
+/**
+ * Compile the raw dictionary files into C source (see image_write_source)
+ *
+ * Used by the build when JDTALK_EMBED_DATA is enabled.
+ */
+int main(int argc, char *argv[]) {
+    struct Dictionary *dict;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s datadir output.c\n", argv[0]);
+        exit(1);
+    }
+    dict = dictionary_populate_text(argv[1], DICT_TYPES_ALL);
+    if (image_write_source(dict, argv[1], argv[2]) < 0) {
+        fprintf(stderr, "Unable to write dictionary source: %s: %s\n", argv[2], strerror(errno));
+        exit(1);
+    }
+    dictionary_free(dict);
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "jdtalk.h"
+
+/**
+ * Get the average length of the words of a dictionary view
+ * @param view pointer to dictionary view
+ * @return average length
+ */
+static size_t format_average(const struct DictionaryView *view) {
+    const struct Dictionary *dict = view->dict;
+    size_t first;
+    size_t last;
+
+    if (!view->count) {
+        return 0;
+    }
+    if (view->type == WT_ANY) {
+        first = 0;
+        last = dict->nelem_inuse - 1;
+    } else {
+        first = view->base;
+        last = view->base + view->count - 1;
+    }
+    // Words are stored back to back, NUL terminated
+    return (dict->offset[last] + dict->nchar[last] - dict->offset[first] + 1 - (last - first + 1)) / (last - first + 1);
+}
+
+/**
+ * Append operations to a compiled format
+ * @param plan pointer to compiled format
+ * @param op operation to append
+ * @param repeat number of times to append op
+ * @return 0=success, -1=too many operations
+ */
+static int format_append(struct Format *plan, const struct FormatOp *op, size_t repeat) {
+    if (repeat > FORMAT_OPS_MAX - plan->nops) {
+        return -1;
+    }
+    if (plan->nops + repeat > plan->nops_alloc) {
+        size_t size = plan->nops_alloc ? plan->nops_alloc : FORMAT_OPS_INITIAL;
+        struct FormatOp *tmp;
+
+        while (size < plan->nops + repeat) {
+            size *= 2;
+        }
+        tmp = realloc(plan->op, size * sizeof(*plan->op));
+        if (!tmp) {
+            perror("Unable to extend format");
+            exit(1);
+        }
+        plan->op = tmp;
+        plan->nops_alloc = size;
+    }
+    for (size_t i = 0; i < repeat; i++) {
+        plan->op[plan->nops++] = *op;
+        plan->expected += op->len + 1;
+    }
+    return 0;
+}
+
+/**
+ * Compile an output format
+ *
+ * a = adjective
+ * d = adverb
+ * n = noun
+ * v = verb
+ * x = any
+ * {text} = text, as a token of its own
+ *
+ * A number after a token repeats it ("a3n" is "aaan"). Tokens are
+ * separated by a space in the output.
+ *
+ * struct Format plan;
+ * if (format_compile(&plan, "a2n{and}v", view) < 0) {
+ *     // invalid format
+ * }
+ * format_free(&plan);
+ *
+ * @param plan pointer to compiled format (release with format_free)
+ * @param fmt output format
+ * @param view array of dictionary views (indexed by word type)
+ * @return 0=success, -1=invalid format
+ */
+int format_compile(struct Format *plan, const char *fmt, const struct DictionaryView *view) {
+    struct FormatOp op;
+    size_t fmt_len;
+    char *literal;
+    int have_op;
+
+    memset(plan, 0, sizeof(*plan));
+    if (!fmt || !*fmt) {
+        return -1;
+    }
+    fmt_len = strlen(fmt);
+    plan->storage = malloc(fmt_len + 1);
+    if (!plan->storage) {
+        perror("Unable to allocate format");
+        exit(1);
+    }
+    literal = plan->storage;
+
+    have_op = 0;
+    for (const char *s = fmt; *s; ) {
+        size_t repeat = 1;
+        int type;
+
+        if (have_op && isdigit((unsigned char) *s)) {
+            char *end;
+            errno = 0;
+            repeat = strtoul(s, &end, 10);
+            if (errno || !repeat) {
+                goto invalid;
+            }
+            s = end;
+            // The token was appended once already
+            if (format_append(plan, &op, repeat - 1) < 0) {
+                goto invalid;
+            }
+            have_op = 0;
+            continue;
+        }
+
+        memset(&op, 0, sizeof(op));
+        if (*s == '{') {
+            const char *end = strchr(s + 1, '}');
+            if (!end || end == s + 1) {
+                goto invalid;
+            }
+            op.len = (size_t) (end - s - 1);
+            op.literal = literal;
+            memcpy(literal, s + 1, op.len);
+            literal[op.len] = '\0';
+            literal += op.len + 1;
+            s = end + 1;
+        } else {
+            type = talk_format_type(*s);
+            if (type < 0) {
+                goto invalid;
+            }
+            op.ch = *s;
+            op.view = &view[type];
+            op.len = format_average(op.view);
+            s++;
+        }
+        if (format_append(plan, &op, 1) < 0) {
+            goto invalid;
+        }
+        have_op = 1;
+    }
+    return 0;
+
+    invalid:
+    format_free(plan);
+    return -1;
+}
+
+/**
+ * Get the word types an output format draws from
+ *
+ * Invalid formats need every type, so format_compile can reject them
+ * against a complete dictionary.
+ *
+ * @param fmt output format (see format_compile)
+ * @return bitmask of word types (1 << WT_*, WT_ANY expands to every type)
+ */
+unsigned format_types(const char *fmt) {
+    unsigned types = 0;
+
+    for (const char *s = fmt; *s; s++) {
+        int type;
+
+        if (*s == '{') {
+            const char *end = strchr(s + 1, '}');
+            if (!end) {
+                return DICT_TYPES_ALL;
+            }
+            s = end;
+            continue;
+        }
+        if (isdigit((unsigned char) *s)) {
+            continue;
+        }
+        type = talk_format_type(*s);
+        if (type < 0 || type == WT_ANY) {
+            return DICT_TYPES_ALL;
+        }
+        types |= 1U << type;
+    }
+    return types;
+}
+
+/**
+ * Determine whether a compiled format holds literal text
+ * @param plan pointer to compiled format
+ * @return 0=no, 1=yes
+ */
+int format_has_literal(const struct Format *plan) {
+    for (size_t i = 0; i < plan->nops; i++) {
+        if (!plan->op[i].view) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Find a token of a compiled format with no words to draw from
+ * @param plan pointer to compiled format
+ * @return format character of the token, or 0 if every token has words
+ */
+char format_empty_view(const struct Format *plan) {
+    for (size_t i = 0; i < plan->nops; i++) {
+        if (plan->op[i].view && !plan->op[i].view->count) {
+            return plan->op[i].ch;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Release a compiled format
+ * @param plan pointer to compiled format
+ */
+void format_free(struct Format *plan) {
+    free(plan->op);
+    free(plan->storage);
+    memset(plan, 0, sizeof(*plan));
+}
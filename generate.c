@@ -0,0 +1,684 @@
+#include <pthread.h>
+#include "jdtalk.h"
+
+// State shared by generate_parallel workers
+struct GenerateShared {
+    const struct DictionaryView *view;
+    const struct Options *opt;
+    const struct TalkPlant *plant;
+    generate_emit_fn emit;
+    void *arg;
+    struct Bench *bench;    // receives the measurements of every worker (NULL=don't measure)
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    size_t nchunks;         // number of chunks to produce (0=unlimited)
+    size_t next_chunk;      // next chunk to claim
+    size_t next_write;      // next chunk to emit (ordered mode)
+    int stopped;            // the destination refused a block of lines
+};
+
+struct GenerateWorker {
+    struct GenerateShared *shared;
+    size_t id;
+    pthread_t thread;
+};
+
+/**
+ * Determine whether a phrase satisfies the search pattern
+ *
+ * @param opt pointer to options
+ * @param line generated phrase
+ * @param parts words of the phrase
+ * @param nparts number of words in parts
+ * @return 0=no match, 1=match
+ */
+int generate_match(const struct Options *opt, const char *line, const char **parts, size_t nparts) {
+    if (!opt->do_exact) {
+        return strstr(line, opt->pattern) != NULL;
+    }
+    for (size_t z = 0; z < nparts; z++) {
+        if (parts[z] && strcmp(parts[z], opt->pattern) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Get the enabled string transformations
+ * @param opt pointer to options
+ * @return transformations to apply (STR_*, 0=none)
+ */
+unsigned generate_transforms(const struct Options *opt) {
+    unsigned flags = 0;
+    if (opt->do_random_case)
+        flags |= STR_RANDOM_CASE;
+    if (opt->do_hill_case)
+        flags |= STR_HILL_CASE;
+    if (opt->do_leet)
+        flags |= STR_LEET;
+    if (opt->do_title_case)
+        flags |= STR_TITLE_CASE;
+    if (opt->do_shuffle)
+        flags |= STR_SHUFFLE;
+    if (opt->do_reverse)
+        flags |= STR_REVERSE;
+    return flags;
+}
+
+/**
+ * Get the number of parts needed to record every word of a phrase
+ * @param opt pointer to options
+ * @return maximum number of words in a phrase
+ */
+size_t generate_parts_max(const struct Options *opt) {
+    if (opt->do_salad) {
+        return opt->salad_limit;
+    } else if (opt->do_heart) {
+        return opt->heart_limit;
+    } else if (opt->do_acronym) {
+        return strlen(opt->acronym);
+    }
+    return opt->plan->nops;
+}
+
+/**
+ * Describe the sources of the word in a position of a phrase
+ * @param view array of dictionary views (indexed by word type)
+ * @param opt pointer to options
+ * @param slot position in the phrase
+ * @param pool array receiving the pools (TALK_POOL_MAX)
+ * @return number of pools
+ */
+static size_t generate_pools(const struct DictionaryView *view, const struct Options *opt, size_t slot, struct TalkPool *pool) {
+    if (opt->do_salad) {
+        struct FormatOp any;
+        memset(&any, 0, sizeof(any));
+        any.view = &view[WT_ANY];
+        any.ch = 'x';
+        return talk_format_pools(&any, pool);
+    } else if (opt->do_heart) {
+        return talk_heart_pools(view, opt->heart_maxlen, slot, pool);
+    } else if (opt->do_acronym) {
+        return talk_acronym_pools(opt->plan, opt->acronym, slot, pool);
+    }
+    return talk_format_pools(&opt->plan->op[slot], pool);
+}
+
+/**
+ * Determine whether two positions draw their words alike
+ * @param a pools of the first position
+ * @param na number of pools in a
+ * @param b pools of the second position
+ * @param nb number of pools in b
+ * @return 0=no, 1=yes
+ */
+static int generate_pools_equal(const struct TalkPool *a, size_t na, const struct TalkPool *b, size_t nb) {
+    if (na != nb) {
+        return 0;
+    }
+    for (size_t i = 0; i < na; i++) {
+        if (a[i].type != b[i].type || a[i].letter != b[i].letter || a[i].maxlen != b[i].maxlen
+            || a[i].weight != b[i].weight || a[i].list != b[i].list || a[i].nlist != b[i].nlist) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Collect the words of a pool satisfying the search pattern
+ *
+ * @param plant pointer to plant
+ * @param view array of dictionary views (indexed by word type)
+ * @param pool pointer to pool
+ * @param match indexes of every dictionary word satisfying the pattern
+ * @param nmatch number of indexes in match
+ * @param count receives the number of words
+ * @param chance receives the probability of the pool producing one of the words
+ * @return array of words (free it)
+ */
+static const char **generate_plant_group(const struct TalkPlant *plant, const struct DictionaryView *view, const struct TalkPool *pool,
+                                         const uint32_t *match, size_t nmatch, size_t *count, double *chance) {
+    const struct Dictionary *dict = view[WT_ANY].dict;
+    const char **words;
+    size_t total;
+
+    words = malloc(((pool->type < 0 ? pool->nlist : nmatch) + 1) * sizeof(*words));
+    if (!words) {
+        perror("Unable to allocate pattern words");
+        exit(1);
+    }
+
+    *count = 0;
+    if (pool->type < 0) {
+        for (size_t i = 0; i < pool->nlist; i++) {
+            if (talk_plant_satisfies(plant, pool->list[i])) {
+                words[(*count)++] = pool->list[i];
+            }
+        }
+        total = pool->nlist;
+    } else {
+        for (size_t i = 0; i < nmatch; i++) {
+            const char *word = dictionary_at(dict, match[i]);
+            if ((pool->type != WT_ANY && dict->type[match[i]] != pool->type)
+                || (pool->letter >= 0 && (unsigned char) *word != pool->letter)
+                || (pool->maxlen && dict->nchar[match[i]] > pool->maxlen)) {
+                continue;
+            }
+            words[(*count)++] = word;
+        }
+        if (pool->letter >= 0) {
+            index_letter(dict, (unsigned) pool->type, (char) pool->letter, &total);
+        } else if (pool->maxlen) {
+            index_length(dict, (unsigned) pool->type, pool->maxlen, &total);
+        } else {
+            total = view[pool->type].count;
+        }
+    }
+
+    *chance = total ? pool->weight * (double) *count / (double) total : 0;
+    return words;
+}
+
+/**
+ * Prepare to plant the search pattern in every phrase
+ *
+ * Each phrase receives a word satisfying the pattern in one position, and
+ * positions before it are kept free of such words. The position is drawn
+ * with the probability of it being the first match of a freely generated
+ * phrase, and the word is drawn from the words of the position satisfying
+ * the pattern, so planted phrases follow the same distribution as phrases
+ * that pass the search pattern.
+ *
+ * Words satisfying a substring pattern are found with the trigram index
+ * (see index_substring). Patterns spanning more than one word can't be
+ * planted.
+ *
+ * @param plant pointer to plant (release with generate_plant_free)
+ * @param view array of dictionary views (indexed by word type)
+ * @param opt pointer to options
+ * @return 0=success, -1=the pattern never appears in a phrase
+ */
+int generate_plant(struct TalkPlant *plant, const struct DictionaryView *view, const struct Options *opt) {
+    const struct Dictionary *dict = view[WT_ANY].dict;
+    struct TalkPool (*pools)[TALK_POOL_MAX];
+    size_t *npools;
+    uint32_t *match;
+    size_t nmatch;
+    double miss;
+    double total;
+
+    memset(plant, 0, sizeof(*plant));
+    plant->pattern = opt->pattern;
+    plant->exact = opt->do_exact;
+    plant->nslots = generate_parts_max(opt);
+    plant->slot = calloc(plant->nslots + 1, sizeof(*plant->slot));
+    plant->first = calloc(plant->nslots + 1, sizeof(*plant->first));
+    pools = NULL;
+    npools = NULL;
+    if (!plant->slot || !plant->first) {
+        perror("Unable to allocate pattern positions");
+        exit(1);
+    }
+
+    if (plant->exact) {
+        const uint32_t *words;
+        size_t count;
+
+        words = index_letter(dict, WT_ANY, *opt->pattern, &count);
+        match = malloc((count + 1) * sizeof(*match));
+        if (!match) {
+            perror("Unable to allocate pattern matches");
+            exit(1);
+        }
+        nmatch = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(dictionary_at(dict, words[i]), opt->pattern) == 0) {
+                match[nmatch++] = words[i];
+            }
+        }
+    } else {
+        match = index_substring(dict, opt->pattern, &nmatch);
+    }
+
+    miss = 1;
+    total = 0;
+    for (size_t slot = 0; slot < plant->nslots; slot++) {
+        struct TalkPool pool[TALK_POOL_MAX];
+        struct TalkPlantSlot *config;
+        size_t npool;
+        size_t c;
+
+        npool = generate_pools(view, opt, slot, pool);
+        for (c = 0; c < plant->nconfig && !generate_pools_equal(pools[c], npools[c], pool, npool); c++);
+        if (c == plant->nconfig) {
+            double chance;
+
+            if (!(plant->nconfig & (plant->nconfig - 1))) {
+                // Grow at powers of two
+                size_t size = plant->nconfig ? plant->nconfig * 2 : 1;
+                plant->config = realloc(plant->config, size * sizeof(*plant->config));
+                pools = realloc(pools, size * sizeof(*pools));
+                npools = realloc(npools, size * sizeof(*npools));
+                if (!plant->config || !pools || !npools) {
+                    perror("Unable to allocate pattern positions");
+                    exit(1);
+                }
+            }
+            memcpy(pools[c], pool, sizeof(pool));
+            npools[c] = npool;
+            config = &plant->config[c];
+            memset(config, 0, sizeof(*config));
+            plant->nconfig++;
+
+            config->ngroups = npool;
+            for (size_t g = 0; g < npool; g++) {
+                config->words[g] = generate_plant_group(plant, view, &pool[g], match, nmatch, &config->count[g], &chance);
+                config->chance += chance;
+                config->weight[g] = config->chance;
+            }
+            for (size_t g = 0; g < npool; g++) {
+                config->weight[g] = config->chance ? config->weight[g] / config->chance : 0;
+            }
+        }
+
+        config = &plant->config[c];
+        plant->slot[slot] = c;
+        total += miss * config->chance;
+        plant->first[slot] = total;
+        miss *= 1 - config->chance;
+    }
+
+    free(match);
+    free(pools);
+    free(npools);
+    if (!plant->nslots || total <= 0) {
+        generate_plant_free(plant);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Release a plant
+ * @param plant pointer to plant
+ */
+void generate_plant_free(struct TalkPlant *plant) {
+    for (size_t c = 0; c < plant->nconfig; c++) {
+        for (size_t g = 0; g < plant->config[c].ngroups; g++) {
+            free((void *) plant->config[c].words[g]);
+        }
+    }
+    free(plant->config);
+    free(plant->slot);
+    free(plant->first);
+    memset(plant, 0, sizeof(*plant));
+}
+
+/**
+ * Produce one phrase satisfying the search pattern
+ * @param ctx pointer to generator context
+ * @param opt pointer to options
+ * @param dest string builder receiving the phrase (cleared first)
+ * @param parts array receiving a pointer to each word
+ * @param parts_max maximum number of parts
+ * @param count receives the number of words recorded in parts (NULL=ignore)
+ * @return number of phrases rejected by the search pattern
+ */
+static size_t generate_phrase(struct Talk *ctx, const struct Options *opt, struct StrBuf *dest, const char **parts, size_t parts_max, size_t *count) {
+    size_t rejected;
+    int nparts;
+
+    for (rejected = 0; ; rejected++) {
+        strbuf_clear(dest);
+        if (ctx->plant) {
+            talk_plant_choose(ctx);
+        }
+        if (opt->do_salad) {
+            nparts = talk_salad_r(ctx, opt->salad_limit, dest, parts, parts_max);
+        } else if (opt->do_heart) {
+            nparts = talk_heart_r(ctx, opt->heart_limit, opt->heart_maxlen, dest, parts, parts_max);
+        } else if (opt->do_acronym) {
+            nparts = talk_acronym_r(ctx, opt->plan, opt->acronym, dest, parts, parts_max);
+        } else {
+            nparts = talk_plan_r(ctx, opt->plan, dest, parts, parts_max);
+        }
+
+        if (!opt->do_pattern || ctx->plant || generate_match(opt, dest->data, parts, nparts > 0 ? (size_t) nparts : 0)) {
+            if (count) {
+                *count = nparts > 0 ? (size_t) nparts : 0;
+            }
+            return rejected;
+        }
+    }
+}
+
+/**
+ * Produce one line of output
+ *
+ * Phrases are generated until one satisfies the search pattern, and then
+ * transformed in a single pass (see str_transform_r). When the generator
+ * context has a plant, the first phrase already satisfies the pattern.
+ *
+ * @param ctx pointer to generator context
+ * @param opt pointer to options
+ * @param out string builder receiving the line (cleared first)
+ * @param phrase string builder holding the phrase before transformation (scratch)
+ * @param parts array receiving a pointer to each word
+ * @param parts_max maximum number of parts
+ * @return number of phrases rejected by the search pattern
+ */
+size_t generate_line(struct Talk *ctx, const struct Options *opt, struct StrBuf *out, struct StrBuf *phrase, const char **parts, size_t parts_max) {
+    unsigned flags;
+    size_t rejected;
+
+    // Without transformations the phrase is the line
+    flags = generate_transforms(opt);
+    rejected = generate_phrase(ctx, opt, flags ? phrase : out, parts, parts_max, NULL);
+    if (flags) {
+        strbuf_clear(out);
+        str_transform_r(phrase->data, phrase->len, flags, ctx->rng, out);
+    }
+    return rejected;
+}
+
+/**
+ * Allocate scratch space for producing chunks of lines
+ * @param batch pointer to batch (release with generate_batch_free)
+ * @param opt pointer to options
+ */
+void generate_batch_init(struct GenerateBatch *batch, const struct Options *opt) {
+    unsigned flags = generate_transforms(opt);
+
+    batch->parts_max = generate_parts_max(opt);
+    batch->parts = calloc(batch->parts_max + 1, sizeof(*batch->parts));
+    if (!batch->parts) {
+        perror("Unable to allocate phrase parts");
+        exit(1);
+    }
+    strbuf_new(&batch->line, 0);
+    strbuf_new(&batch->phrase, 0);
+    strbuf_new(&batch->chunk, 0);
+    str_case_init(&batch->upper, flags);
+    batch->batch_case = str_case_batchable(flags);
+    batch->bench = NULL;
+    batch->line_parts = NULL;
+    batch->line_parts_len = 0;
+    batch->line_parts_alloc = 0;
+    batch->keep_parts = opt->do_parts;
+}
+
+/**
+ * Release scratch space for producing chunks of lines
+ * @param batch pointer to batch
+ */
+void generate_batch_free(struct GenerateBatch *batch) {
+    str_case_free(&batch->upper);
+    strbuf_free(&batch->chunk);
+    strbuf_free(&batch->phrase);
+    strbuf_free(&batch->line);
+    free(batch->parts);
+    batch->parts = NULL;
+    free(batch->line_parts);
+    batch->line_parts = NULL;
+}
+
+/**
+ * Keep the words of each line of a chunk
+ * @param batch pointer to batch
+ * @param parts words of the line
+ * @param nparts number of words in parts
+ */
+static void generate_keep_parts(struct GenerateBatch *batch, const char **parts, size_t nparts) {
+    if (batch->line_parts_len + nparts + 1 > batch->line_parts_alloc) {
+        size_t alloc = batch->line_parts_alloc ? batch->line_parts_alloc * 2 : 256;
+        const char **tmp;
+
+        while (alloc < batch->line_parts_len + nparts + 1) {
+            alloc *= 2;
+        }
+        tmp = realloc(batch->line_parts, alloc * sizeof(*tmp));
+        if (!tmp) {
+            perror("Unable to extend line parts");
+            exit(1);
+        }
+        batch->line_parts = tmp;
+        batch->line_parts_alloc = alloc;
+    }
+    memcpy(batch->line_parts + batch->line_parts_len, parts, nparts * sizeof(*parts));
+    batch->line_parts_len += nparts;
+    batch->line_parts[batch->line_parts_len++] = NULL;
+}
+
+/**
+ * Produce a chunk of lines
+ *
+ * When the transformations only change letter case, phrases are collected
+ * untouched and converted together (see str_case_apply). Otherwise each
+ * line is transformed as it is produced. Both produce the same lines from
+ * the same random stream.
+ *
+ * When the batch has measurements, the time spent generating phrases and
+ * transforming them and the latency of each line are recorded. Case
+ * conversions of the whole chunk count as transform time, but not toward
+ * the latency of any line.
+ *
+ * When the batch keeps parts, batch->line_parts receives the words of each
+ * line, and a NULL after the words of each line.
+ *
+ * @param ctx pointer to generator context
+ * @param opt pointer to options
+ * @param batch pointer to batch (batch->chunk receives the newline terminated lines)
+ * @param nlines number of lines to produce
+ * @return number of phrases rejected by the search pattern
+ */
+size_t generate_chunk(struct Talk *ctx, const struct Options *opt, struct GenerateBatch *batch, size_t nlines) {
+    struct Bench *bench = batch->bench;
+    unsigned flags = generate_transforms(opt);
+    size_t rejected = 0;
+    uint64_t start = 0;
+    uint64_t generated = 0;
+    uint64_t transformed = 0;
+
+    strbuf_clear(&batch->chunk);
+    batch->line_parts_len = 0;
+    if (batch->batch_case) {
+        str_case_clear(&batch->upper);
+    }
+    for (size_t i = 0; i < nlines; i++) {
+        size_t pos = batch->chunk.len;
+        size_t nparts;
+
+        if (bench) {
+            start = bench_now();
+        }
+        // Without transformations the phrase is the line
+        rejected += generate_phrase(ctx, opt, flags && !batch->batch_case ? &batch->phrase : &batch->line, batch->parts, batch->parts_max, &nparts);
+        if (batch->keep_parts) {
+            generate_keep_parts(batch, batch->parts, nparts);
+        }
+        if (bench) {
+            generated = bench_now();
+            bench->phase[BENCH_GENERATE] += generated - start;
+        }
+        if (batch->batch_case) {
+            str_case_line(&batch->upper, pos, batch->line.len, ctx->rng);
+        } else if (flags) {
+            strbuf_clear(&batch->line);
+            str_transform_r(batch->phrase.data, batch->phrase.len, flags, ctx->rng, &batch->line);
+        }
+        strbuf_append(&batch->chunk, batch->line.data, batch->line.len);
+        strbuf_putc(&batch->chunk, '\n');
+        if (bench) {
+            transformed = bench_now();
+            bench->phase[BENCH_TRANSFORM] += transformed - generated;
+            bench_latency(bench, transformed - start);
+        }
+    }
+    if (batch->batch_case) {
+        if (bench) {
+            start = bench_now();
+        }
+        str_case_apply(&batch->upper, batch->chunk.data, batch->chunk.len);
+        if (bench) {
+            bench->phase[BENCH_TRANSFORM] += bench_now() - start;
+        }
+    }
+    if (bench) {
+        bench->lines += nlines;
+        bench->bytes += batch->chunk.len;
+        bench->rejected += rejected;
+    }
+    return rejected;
+}
+
+/**
+ * Produce a chunk of lines in a worker thread
+ * @param arg pointer to GenerateWorker
+ * @return NULL
+ */
+static void *generate_worker(void *arg) {
+    struct GenerateWorker *worker = arg;
+    struct GenerateShared *shared = worker->shared;
+    const struct Options *opt = shared->opt;
+    struct GenerateBatch batch;
+    struct Bench *bench = NULL;
+    struct Talk ctx;
+    struct Rng rng;
+
+    talk_init(&ctx, shared->view, &rng);
+    ctx.plant = shared->plant;
+    generate_batch_init(&batch, opt);
+    if (shared->bench) {
+        bench = malloc(sizeof(*bench));
+        if (!bench) {
+            perror("Unable to allocate benchmark");
+            exit(1);
+        }
+        bench_init(bench);
+        batch.bench = bench;
+    }
+    if (opt->do_unordered) {
+        // One stream per worker
+        rng_seed_stream(&rng, opt->seed, worker->id);
+    }
+
+    while (1) {
+        size_t chunk_id;
+        size_t nlines;
+
+        pthread_mutex_lock(&shared->lock);
+        chunk_id = shared->next_chunk;
+        if (shared->stopped || (shared->nchunks && chunk_id >= shared->nchunks)) {
+            pthread_mutex_unlock(&shared->lock);
+            break;
+        }
+        shared->next_chunk++;
+        pthread_mutex_unlock(&shared->lock);
+
+        if (!opt->do_unordered) {
+            // One stream per chunk, so the output does not depend on the number of workers
+            rng_seed_stream(&rng, opt->seed, chunk_id);
+        }
+
+        nlines = GENERATE_CHUNK_LINES;
+        if (opt->limit && opt->limit - chunk_id * GENERATE_CHUNK_LINES < nlines) {
+            nlines = opt->limit - chunk_id * GENERATE_CHUNK_LINES;
+        }
+
+        generate_chunk(&ctx, opt, &batch, nlines);
+
+        pthread_mutex_lock(&shared->lock);
+        if (!opt->do_unordered) {
+            while (!shared->stopped && shared->next_write != chunk_id) {
+                pthread_cond_wait(&shared->turn, &shared->lock);
+            }
+        }
+        if (shared->stopped) {
+            pthread_mutex_unlock(&shared->lock);
+            break;
+        }
+        if (bench) {
+            uint64_t start = bench_now();
+            if (shared->emit(shared->arg, batch.chunk.data, batch.chunk.len, batch.line_parts, nlines) < 0) {
+                shared->stopped = 1;
+            }
+            bench->phase[BENCH_OUTPUT] += bench_now() - start;
+        } else if (shared->emit(shared->arg, batch.chunk.data, batch.chunk.len, batch.line_parts, nlines) < 0) {
+            shared->stopped = 1;
+        }
+        shared->next_write++;
+        pthread_cond_broadcast(&shared->turn);
+        pthread_mutex_unlock(&shared->lock);
+    }
+
+    if (bench) {
+        bench->redrawn += ctx.redrawn;
+        pthread_mutex_lock(&shared->lock);
+        bench_merge(shared->bench, bench);
+        pthread_mutex_unlock(&shared->lock);
+        free(bench);
+    }
+    generate_batch_free(&batch);
+    return NULL;
+}
+
+/**
+ * Produce lines of output with several worker threads
+ *
+ * Lines are produced in chunks of GENERATE_CHUNK_LINES. In ordered mode
+ * each chunk draws from its own random stream and chunks are emitted in
+ * sequence, so a seed always produces the same output. In unordered mode
+ * each worker draws from its own stream and emits chunks as soon as they
+ * are ready. Generation stops early when emit returns -1.
+ *
+ * @param view array of dictionary views (indexed by word type)
+ * @param opt pointer to options (limit=0 runs forever)
+ * @param plant pointer to plant of the exact search pattern (NULL=none)
+ * @param emit function receiving each chunk of newline terminated lines
+ * @param arg passed to emit
+ * @param bench pointer to measurements receiving those of every worker (NULL=don't measure)
+ * @return 0=success, -1=unable to start workers
+ */
+int generate_parallel(const struct DictionaryView *view, const struct Options *opt, const struct TalkPlant *plant, generate_emit_fn emit, void *arg, struct Bench *bench) {
+    struct GenerateShared shared;
+    struct GenerateWorker *workers;
+    size_t started;
+    int result;
+
+    memset(&shared, 0, sizeof(shared));
+    shared.view = view;
+    shared.opt = opt;
+    shared.plant = plant;
+    shared.emit = emit;
+    shared.arg = arg;
+    shared.bench = bench;
+    shared.nchunks = (opt->limit + GENERATE_CHUNK_LINES - 1) / GENERATE_CHUNK_LINES;
+    pthread_mutex_init(&shared.lock, NULL);
+    pthread_cond_init(&shared.turn, NULL);
+
+    workers = calloc(opt->threads, sizeof(*workers));
+    if (!workers) {
+        perror("Unable to allocate worker threads");
+        exit(1);
+    }
+
+    result = 0;
+    for (started = 0; started < opt->threads; started++) {
+        workers[started].shared = &shared;
+        workers[started].id = started;
+        if (pthread_create(&workers[started].thread, NULL, generate_worker, &workers[started]) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    free(workers);
+    pthread_cond_destroy(&shared.turn);
+    pthread_mutex_destroy(&shared.lock);
+    return started ? 0 : result;
+}
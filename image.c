@@ -0,0 +1,786 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jdtalk.h"
+
+#define IMAGE_ALIGN 8
+#define IMAGE_ALIGN_UP(X) (((X) + (IMAGE_ALIGN - 1)) & ~((uint64_t) IMAGE_ALIGN - 1))
+
+/**
+ * Reserve space for a section at the end of an image
+ *
+ * @param hdr pointer to image header
+ * @param id section identifier (DICT_SECTION_*)
+ * @param size size of section in bytes
+ * @return offset of the section
+ */
+static uint64_t image_section_add(struct DictionaryImageHeader *hdr, uint32_t id, uint64_t size) {
+    struct DictionaryImageSection *section;
+
+    section = &hdr->sections[hdr->nsections++];
+    section->id = id;
+    section->offset = IMAGE_ALIGN_UP(hdr->size);
+    section->size = size;
+    hdr->size = section->offset + size;
+    return section->offset;
+}
+
+/**
+ * Locate a section in a mapped image
+ *
+ * @param hdr pointer to image header
+ * @param id section identifier (DICT_SECTION_*)
+ * @param size expected size of section in bytes (0=any size, receives the actual size)
+ * @return pointer to section data, or NULL if the section is missing or malformed
+ */
+static const void *image_section(const struct DictionaryImageHeader *hdr, uint32_t id, uint64_t *size) {
+    for (size_t i = 0; i < hdr->nsections; i++) {
+        const struct DictionaryImageSection *section = &hdr->sections[i];
+        if (section->id != id) {
+            continue;
+        }
+        if ((*size && section->size != *size) || section->offset > hdr->size || section->size > hdr->size - section->offset) {
+            return NULL;
+        }
+        *size = section->size;
+        return (const char *) hdr + section->offset;
+    }
+    return NULL;
+}
+
+/**
+ * Serialize a dictionary into a binary image
+ *
+ * @param dict pointer to populated and indexed dictionary
+ * @param datadir path to raw dictionary files the image is compiled from
+ * @param size receives the size of the image in bytes
+ * @return image (free it), or NULL if a raw dictionary file could not be inspected (errno is set)
+ */
+static char *image_build(struct Dictionary *dict, const char *datadir, uint64_t *size) {
+    struct DictionaryImageHeader hdr;
+    uint64_t strings_size;
+    uint64_t off_strings, off_offsets, off_lengths, off_types, off_ranges, off_hash, off_hash_icase;
+    uint64_t hash_size;
+    uint64_t off_letter, off_letter_start, letter_size, letter_start_size;
+    uint64_t off_length, off_length_start, length_start_size;
+    uint64_t off_trigram, off_trigram_start, trigram_size, trigram_start_size;
+    char *image;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DICT_IMAGE_MAGIC, sizeof(DICT_IMAGE_MAGIC));
+    hdr.version = DICT_IMAGE_VERSION;
+    hdr.endian = DICT_IMAGE_ENDIAN;
+    hdr.nelem = dict->nelem_inuse;
+    hdr.size = sizeof(hdr);
+    if (dictionary_sources(datadir, hdr.sources) < 0) {
+        return NULL;
+    }
+
+    strings_size = dict->arena_inuse;
+
+    off_strings = image_section_add(&hdr, DICT_SECTION_STRINGS, strings_size);
+    off_offsets = image_section_add(&hdr, DICT_SECTION_OFFSETS, hdr.nelem * sizeof(uint32_t));
+    off_lengths = image_section_add(&hdr, DICT_SECTION_LENGTHS, hdr.nelem * sizeof(uint32_t));
+    off_types = image_section_add(&hdr, DICT_SECTION_TYPES, hdr.nelem * sizeof(uint8_t));
+    off_ranges = image_section_add(&hdr, DICT_SECTION_RANGES, sizeof(dict->range));
+    hash_size = dict->hash_size * sizeof(*dict->hash);
+    off_hash = image_section_add(&hdr, DICT_SECTION_HASH, hash_size);
+    off_hash_icase = image_section_add(&hdr, DICT_SECTION_HASH_ICASE, hash_size);
+    letter_size = 2 * hdr.nelem * sizeof(*dict->letter);
+    letter_start_size = (WT_VERB + 1) * INDEX_LETTER_BUCKETS * sizeof(*dict->letter_start);
+    off_letter = image_section_add(&hdr, DICT_SECTION_LETTER, letter_size);
+    off_letter_start = image_section_add(&hdr, DICT_SECTION_LETTER_START, letter_start_size);
+    length_start_size = (WT_VERB + 1) * INDEX_LENGTH_BUCKETS * sizeof(*dict->length_start);
+    off_length = image_section_add(&hdr, DICT_SECTION_LENGTH, letter_size);
+    off_length_start = image_section_add(&hdr, DICT_SECTION_LENGTH_START, length_start_size);
+    trigram_size = dict->trigram_size * sizeof(*dict->trigram);
+    trigram_start_size = INDEX_TRIGRAM_BUCKETS * sizeof(*dict->trigram_start);
+    off_trigram = image_section_add(&hdr, DICT_SECTION_TRIGRAM, trigram_size);
+    off_trigram_start = image_section_add(&hdr, DICT_SECTION_TRIGRAM_START, trigram_start_size);
+    hdr.size = IMAGE_ALIGN_UP(hdr.size);
+
+    image = calloc(hdr.size, 1);
+    if (!image) {
+        perror("Unable to allocate dictionary image");
+        exit(1);
+    }
+
+    memcpy(image + off_strings, dict->arena, strings_size);
+    memcpy(image + off_offsets, dict->offset, hdr.nelem * sizeof(*dict->offset));
+    memcpy(image + off_lengths, dict->nchar, hdr.nelem * sizeof(*dict->nchar));
+    memcpy(image + off_types, dict->type, hdr.nelem * sizeof(*dict->type));
+    memcpy(image + off_ranges, dict->range, sizeof(dict->range));
+    memcpy(image + off_hash, dict->hash, hash_size);
+    memcpy(image + off_hash_icase, dict->hash_icase, hash_size);
+    memcpy(image + off_letter, dict->letter, letter_size);
+    memcpy(image + off_letter_start, dict->letter_start, letter_start_size);
+    memcpy(image + off_length, dict->length, letter_size);
+    memcpy(image + off_length_start, dict->length_start, length_start_size);
+    memcpy(image + off_trigram, dict->trigram, trigram_size);
+    memcpy(image + off_trigram_start, dict->trigram_start, trigram_start_size);
+    memcpy(image, &hdr, sizeof(hdr));
+    *size = hdr.size;
+    return image;
+}
+
+/**
+ * Compile a dictionary into a binary image
+ *
+ * The image is written to a temporary file and renamed into place, so
+ * concurrent readers never observe a partial image.
+ *
+ * @param dict pointer to populated and indexed dictionary
+ * @param datadir path to raw dictionary files the image is compiled from
+ * @param filename name of image inside datadir
+ * @return 0=success, -1=failure (errno is set)
+ */
+int image_write(struct Dictionary *dict, const char *datadir, const char *filename) {
+    char path[PATH_MAX];
+    char path_tmp[PATH_MAX + 32];
+    uint64_t size;
+    char *image;
+    FILE *fp;
+
+    image = image_build(dict, datadir, &size);
+    if (!image) {
+        return -1;
+    }
+
+    if ((size_t) snprintf(path, sizeof(path), "%s/%s", datadir, filename) >= sizeof(path)) {
+        free(image);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(path_tmp, sizeof(path_tmp), "%s.%ld.tmp", path, (long) getpid());
+    fp = fopen(path_tmp, "wb");
+    if (!fp) {
+        free(image);
+        return -1;
+    }
+    if (fwrite(image, 1, size, fp) != size) {
+        int err = errno;
+        fclose(fp);
+        unlink(path_tmp);
+        free(image);
+        errno = err;
+        return -1;
+    }
+    free(image);
+    if (fclose(fp) != 0 || rename(path_tmp, path) < 0) {
+        int err = errno;
+        unlink(path_tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Compile a dictionary into C source
+ *
+ * The source defines image_embedded_data and image_embedded_size, an image
+ * as written by image_write, stored as one string literal so the compiler
+ * places it in read-only data without parsing millions of initializers.
+ *
+ * @param dict pointer to populated and indexed dictionary
+ * @param datadir path to raw dictionary files the image is compiled from
+ * @param filename path of C source to write
+ * @return 0=success, -1=failure (errno is set)
+ */
+int image_write_source(struct Dictionary *dict, const char *datadir, const char *filename) {
+    uint64_t size;
+    size_t column;
+    char *image;
+    FILE *fp;
+
+    image = image_build(dict, datadir, &size);
+    if (!image) {
+        return -1;
+    }
+    fp = fopen(filename, "w");
+    if (!fp) {
+        free(image);
+        return -1;
+    }
+
+    fprintf(fp, "// Generated by jdtalk_embed from %s. Do not edit.\n", datadir);
+    fprintf(fp, "#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(fp, "static const union {\n    char bytes[%llu];\n    uint64_t align;\n} image = {\n\"", (unsigned long long) size);
+    column = 0;
+    for (uint64_t i = 0; i < size; i++) {
+        unsigned char ch = (unsigned char) image[i];
+        if (column >= 120) {
+            fputs("\"\n\"", fp);
+            column = 0;
+        }
+        // Octal escapes stop after three digits, so any character may follow one
+        if (ch >= ' ' && ch <= '~' && ch != '"' && ch != '\\' && ch != '?') {
+            fputc(ch, fp);
+            column++;
+        } else {
+            fprintf(fp, "\\%03o", ch);
+            column += 4;
+        }
+    }
+    fprintf(fp, "\"\n};\n\n");
+    fprintf(fp, "const char *const image_embedded_data = image.bytes;\n");
+    fprintf(fp, "const size_t image_embedded_size = sizeof(image.bytes);\n");
+    free(image);
+
+    if (ferror(fp)) {
+        fclose(fp);
+        errno = EIO;
+        return -1;
+    }
+    return fclose(fp);
+}
+
+/**
+ * Determine whether the bucket starts of a bucketed word index are in bounds
+ *
+ * @param start bucket starts
+ * @param nbuckets number of bucket starts
+ * @param nelem number of word indexes in the bucketed index
+ * @return 0=invalid, 1=valid
+ */
+static int image_buckets_valid(const uint32_t *start, size_t nbuckets, uint64_t nelem) {
+    for (size_t i = 0; i < nbuckets; i++) {
+        if (start[i] > nelem || (i && start[i] < start[i - 1])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Determine whether the group starts of a grouped word index are in bounds
+ *
+ * @param start group starts of every word type (nbuckets per type)
+ * @param nbuckets number of group starts per word type
+ * @param nelem number of word indexes in the grouped index
+ * @return 0=invalid, 1=valid
+ */
+static int image_groups_valid(const uint32_t *start, size_t nbuckets, uint64_t nelem) {
+    for (size_t type = 0; type <= WT_VERB; type++) {
+        if (!image_buckets_valid(&start[type * nbuckets], nbuckets, nelem)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Determine whether the word indexes of an index are in bounds
+ *
+ * @param index word indexes
+ * @param count number of word indexes
+ * @param nelem number of words in the dictionary
+ * @return 0=invalid, 1=valid
+ */
+static int image_indexes_valid(const uint32_t *index, uint64_t count, uint64_t nelem) {
+    uint32_t max = 0;
+
+    // No early exit, so the loop vectorizes
+    for (uint64_t i = 0; i < count; i++) {
+        max = index[i] > max ? index[i] : max;
+    }
+    return !count || max < nelem;
+}
+
+/**
+ * Determine whether the word indexes of a grouped word index are in bounds
+ *
+ * @param index word indexes of every word type
+ * @param start group starts of every word type (nbuckets per type, see image_groups_valid)
+ * @param nbuckets number of group starts per word type
+ * @param nelem number of words in the dictionary
+ * @return 0=invalid, 1=valid
+ */
+static int image_groups_indexes_valid(const uint32_t *index, const uint32_t *start, size_t nbuckets, uint64_t nelem) {
+    for (size_t type = 0; type <= WT_VERB; type++) {
+        const uint32_t *group = &start[type * nbuckets];
+        if (!image_indexes_valid(&index[group[0]], group[nbuckets - 1] - group[0], nelem)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Determine whether the slots of a lookup table refer to words of the dictionary
+ *
+ * The table must be no fuller than index_build makes it, so every probe
+ * sequence reaches an empty slot.
+ *
+ * @param hash lookup table
+ * @param hash_size number of slots
+ * @param nelem number of words in the dictionary
+ * @return 0=invalid, 1=valid
+ */
+static int image_hash_valid(const struct DictionaryHashSlot *hash, uint64_t hash_size, uint64_t nelem) {
+    uint64_t used = 0;
+    int bad = 0;
+
+    // Load factor at or below 0.75 (see index_build)
+    if (hash_size < nelem + nelem / 3 + 1) {
+        return 0;
+    }
+    for (uint64_t i = 0; i < hash_size; i++) {
+        used += hash[i].hash != 0;
+        bad |= (hash[i].hash != 0) & ((hash[i].index >= nelem) | ((hash[i].types >> (WT_VERB + 1)) != 0));
+    }
+    return !bad && used <= nelem;
+}
+
+/**
+ * Determine whether every word of an image lies within its strings
+ *
+ * @param strings NUL terminated words
+ * @param strings_size size of strings in bytes
+ * @param offsets offset of each word in strings
+ * @param lengths length of each word
+ * @param types type of each word
+ * @param nelem number of words
+ * @return 0=invalid, 1=valid
+ */
+static int image_words_valid(const char *strings, uint64_t strings_size, const uint32_t *offsets, const uint32_t *lengths,
+                             const uint8_t *types, uint64_t nelem) {
+    int bad = 0;
+
+    for (uint64_t i = 0; i < nelem; i++) {
+        uint64_t end = (uint64_t) offsets[i] + lengths[i];
+        if (end >= strings_size || strings[end] != '\0') {
+            return 0;
+        }
+        bad |= types[i] > WT_VERB;
+    }
+    return !bad;
+}
+
+/**
+ * Use a compiled dictionary image in place
+ *
+ * @param image image data (8-byte aligned, must outlive the dictionary)
+ * @param size size of image in bytes
+ * @param datadir path to raw dictionary files the image was compiled from (NULL=don't check for staleness)
+ * @param path name of image (for diagnostics)
+ * @return populated dictionary, or NULL if the image is stale (errno=ESTALE) or unusable (errno=EINVAL)
+ */
+static struct Dictionary *image_use(const void *image, uint64_t size, const char *datadir, const char *path) {
+    struct DictionarySource sources[DICT_SOURCE_MAX];
+    const struct DictionaryImageHeader *hdr;
+    const struct DictionaryRange *ranges;
+    const char *strings;
+    const uint32_t *offsets;
+    const uint32_t *lengths;
+    const uint8_t *types;
+    const struct DictionaryHashSlot *hash;
+    const struct DictionaryHashSlot *hash_icase;
+    const uint32_t *letter;
+    const uint32_t *letter_start;
+    const uint32_t *length;
+    const uint32_t *length_start;
+    const uint32_t *trigram;
+    const uint32_t *trigram_start;
+    uint64_t letter_size, letter_start_size, length_size, length_start_size;
+    uint64_t trigram_size, trigram_start_size;
+    uint64_t strings_size, offsets_size, lengths_size, types_size, ranges_size, hash_size, hash_icase_size;
+    struct Dictionary *dict;
+
+    if (size < sizeof(*hdr)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    hdr = image;
+    if (memcmp(hdr->magic, DICT_IMAGE_MAGIC, sizeof(DICT_IMAGE_MAGIC)) != 0
+        || hdr->version != DICT_IMAGE_VERSION
+        || hdr->endian != DICT_IMAGE_ENDIAN
+        || hdr->size != size
+        || hdr->nsections > DICT_SECTION_MAX) {
+        goto unusable;
+    }
+
+    // The image is stale when any raw dictionary file has changed since it was compiled
+    if (datadir && (dictionary_sources(datadir, sources) < 0 || memcmp(sources, hdr->sources, sizeof(sources)) != 0)) {
+        errno = ESTALE;
+        return NULL;
+    }
+
+    strings_size = 0;
+    offsets_size = lengths_size = hdr->nelem * sizeof(uint32_t);
+    types_size = hdr->nelem * sizeof(uint8_t);
+    ranges_size = (WT_VERB + 1) * sizeof(*ranges);
+    strings = image_section(hdr, DICT_SECTION_STRINGS, &strings_size);
+    offsets = image_section(hdr, DICT_SECTION_OFFSETS, &offsets_size);
+    lengths = image_section(hdr, DICT_SECTION_LENGTHS, &lengths_size);
+    types = image_section(hdr, DICT_SECTION_TYPES, &types_size);
+    ranges = image_section(hdr, DICT_SECTION_RANGES, &ranges_size);
+    hash_size = 0;
+    hash = image_section(hdr, DICT_SECTION_HASH, &hash_size);
+    hash_icase_size = hash_size;
+    hash_icase = image_section(hdr, DICT_SECTION_HASH_ICASE, &hash_icase_size);
+    letter_size = 2 * hdr->nelem * sizeof(*letter);
+    letter_start_size = (WT_VERB + 1) * INDEX_LETTER_BUCKETS * sizeof(*letter_start);
+    letter = image_section(hdr, DICT_SECTION_LETTER, &letter_size);
+    letter_start = image_section(hdr, DICT_SECTION_LETTER_START, &letter_start_size);
+    length_size = letter_size;
+    length_start_size = (WT_VERB + 1) * INDEX_LENGTH_BUCKETS * sizeof(*length_start);
+    length = image_section(hdr, DICT_SECTION_LENGTH, &length_size);
+    length_start = image_section(hdr, DICT_SECTION_LENGTH_START, &length_start_size);
+    trigram_size = 0;
+    trigram_start_size = INDEX_TRIGRAM_BUCKETS * sizeof(*trigram_start);
+    trigram = image_section(hdr, DICT_SECTION_TRIGRAM, &trigram_size);
+    trigram_start = image_section(hdr, DICT_SECTION_TRIGRAM_START, &trigram_start_size);
+    if (!strings || !offsets || !lengths || !types || !ranges || !hash || !hash_icase
+        || !letter || !letter_start || !length || !length_start || !trigram || !trigram_start) {
+        goto malformed;
+    }
+
+    // Lookup tables must have a power of two number of slots
+    hash_size /= sizeof(*hash);
+    if (!hash_size || (hash_size & (hash_size - 1))) {
+        goto malformed;
+    }
+
+    for (size_t i = 0; i <= WT_VERB; i++) {
+        if ((uint64_t) ranges[i].base + ranges[i].count > hdr->nelem) {
+            goto malformed;
+        }
+    }
+
+    if (!image_groups_valid(letter_start, INDEX_LETTER_BUCKETS, 2 * hdr->nelem)
+        || !image_groups_valid(length_start, INDEX_LENGTH_BUCKETS, 2 * hdr->nelem)
+        || !image_buckets_valid(trigram_start, INDEX_TRIGRAM_BUCKETS, trigram_size / sizeof(*trigram))) {
+        goto malformed;
+    }
+
+    // The strings must be terminated, everything else is used in place
+    if (!strings_size || strings[strings_size - 1] != '\0') {
+        goto malformed;
+    }
+
+    // Every value used as an index into the strings or the views must be in bounds
+    if (!image_words_valid(strings, strings_size, offsets, lengths, types, hdr->nelem)
+        || !image_hash_valid(hash, hash_size, hdr->nelem)
+        || !image_hash_valid(hash_icase, hash_size, hdr->nelem)
+        || !image_groups_indexes_valid(letter, letter_start, INDEX_LETTER_BUCKETS, hdr->nelem)
+        || !image_groups_indexes_valid(length, length_start, INDEX_LENGTH_BUCKETS, hdr->nelem)
+        || !image_indexes_valid(trigram, trigram_size / sizeof(*trigram), hdr->nelem)) {
+        goto malformed;
+    }
+
+    dict = calloc(1, sizeof(*dict));
+    if (!dict) {
+        perror("Unable to initialize new dictionary");
+        exit(1);
+    }
+    dict->arena = (char *) strings;
+    dict->offset = (uint32_t *) offsets;
+    dict->nchar = (uint32_t *) lengths;
+    dict->type = (uint8_t *) types;
+    dict->arena_alloc = strings_size;
+    dict->arena_inuse = strings_size;
+    dict->hash = (struct DictionaryHashSlot *) hash;
+    dict->hash_icase = (struct DictionaryHashSlot *) hash_icase;
+    dict->hash_size = hash_size;
+    memcpy(dict->range, ranges, sizeof(dict->range));
+    dict->letter = (uint32_t *) letter;
+    dict->letter_start = (uint32_t *) letter_start;
+    dict->length = (uint32_t *) length;
+    dict->length_start = (uint32_t *) length_start;
+    dict->trigram = (uint32_t *) trigram;
+    dict->trigram_start = (uint32_t *) trigram_start;
+    dict->trigram_size = trigram_size / sizeof(*trigram);
+    dict->nelem_alloc = hdr->nelem;
+    dict->nelem_inuse = hdr->nelem;
+    dict->image = (void *) image;
+    dict->image_size = 0;
+    return dict;
+
+    malformed:
+    fprintf(stderr, "Ignoring malformed dictionary image: %s\n", path);
+    unusable:
+    errno = EINVAL;
+    return NULL;
+}
+
+/**
+ * Map a compiled dictionary image from an open file
+ *
+ * @param fd descriptor of image (left open)
+ * @param datadir path to raw dictionary files the image was compiled from
+ * @param path name of image (for diagnostics)
+ * @return populated dictionary, or NULL if the image is stale (errno=ESTALE) or unusable
+ */
+static struct Dictionary *image_map(int fd, const char *datadir, const char *path) {
+    struct Dictionary *dict;
+    struct stat st;
+    void *image;
+
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+    dict = image_use(image, (uint64_t) st.st_size, datadir, path);
+    if (!dict) {
+        int err = errno;
+        munmap(image, st.st_size);
+        errno = err;
+        return NULL;
+    }
+    dict->image_size = st.st_size;
+    return dict;
+}
+
+/**
+ * Map a compiled dictionary image
+ *
+ * @param datadir path to raw dictionary files the image was compiled from
+ * @param filename name of image inside datadir
+ * @return populated dictionary, or NULL if the image is missing, stale, or unusable
+ */
+struct Dictionary *image_load(const char *datadir, const char *filename) {
+    struct Dictionary *dict;
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", datadir, filename);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    dict = image_map(fd, datadir, path);
+    close(fd);
+    return dict;
+}
+
+#ifdef JDTALK_EMBED_DATA
+/**
+ * Use the dictionary image built into the program (see image_write_source)
+ * @return populated dictionary (read-only), or NULL if the image is unusable
+ */
+struct Dictionary *image_embedded() {
+    return image_use(image_embedded_data, image_embedded_size, NULL, "built-in dictionary");
+}
+#endif
+
+/**
+ * Get the name of the shared memory segment holding the image of a data directory
+ * @param datadir path to raw dictionary files
+ * @param name buffer receiving the name (NAME_MAX bytes)
+ */
+static void image_shm_name(const char *datadir, char *name) {
+    char path[PATH_MAX];
+    uint32_t hash = 2166136261U;
+
+    // Every spelling of the same directory shares one segment
+    if (!realpath(datadir, path)) {
+        snprintf(path, sizeof(path), "%s", datadir);
+    }
+    for (const char *ch = path; *ch; ch++) {
+        hash ^= (unsigned char) *ch;
+        hash *= 16777619U;
+    }
+    // Each user publishes their own segment
+    snprintf(name, NAME_MAX, "/jdtalk-%u-%lu-%08x", (unsigned) DICT_IMAGE_VERSION, (unsigned long) geteuid(), (unsigned) hash);
+}
+
+/**
+ * Lock a data directory against concurrent publishing
+ *
+ * Publishers hold the lock exclusively while they fill a segment, and
+ * attachers hold it shared while they decide a segment was abandoned. The
+ * lock goes away with its process, so a publisher that dies mid-way never
+ * blocks anyone.
+ *
+ * @param datadir path to raw dictionary files
+ * @param operation LOCK_SH or LOCK_EX
+ * @return descriptor holding the lock (close it to unlock), or -1 if it wasn't granted within DICT_SHM_WAIT_MS
+ */
+static int image_shm_lock(const char *datadir, int operation) {
+    struct timespec pause = {0, 10 * 1000000L};
+    int fd;
+
+    fd = open(datadir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    for (long waited = 0; flock(fd, operation | LOCK_NB) < 0; waited += 10) {
+        if (errno != EWOULDBLOCK || waited >= DICT_SHM_WAIT_MS) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return fd;
+}
+
+/**
+ * Attach to a published segment
+ *
+ * Segment names are predictable, so a segment is only trusted when it
+ * belongs to us and nobody else can write to it.
+ *
+ * @param datadir path to raw dictionary files
+ * @param name name of segment
+ * @return populated dictionary (read-only), or NULL if the segment is missing, untrusted (errno=EPERM) or unusable (errno is set)
+ */
+static struct Dictionary *image_attach_segment(const char *datadir, const char *name) {
+    struct Dictionary *dict;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        fprintf(stderr, "Ignoring shared dictionary owned or writable by another user: /dev/shm%s\n", name);
+        close(fd);
+        errno = EPERM;
+        return NULL;
+    }
+    dict = image_map(fd, datadir, name);
+    if (!dict) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    close(fd);
+    return dict;
+}
+
+/**
+ * Attach to the dictionary image another process published in shared memory
+ *
+ * A segment compiled from older raw dictionary files is removed, so the
+ * next process to load the text dictionary publishes a fresh one. So is a
+ * segment left unfinished by a publisher that died: once the publishing
+ * lock is free, a segment without its magic number will never get one.
+ *
+ * @param datadir path to raw dictionary files
+ * @return populated dictionary (read-only), or NULL if no usable image is published (errno=EPERM: untrusted segment)
+ */
+struct Dictionary *image_attach(const char *datadir) {
+    struct Dictionary *dict;
+    char name[NAME_MAX];
+    int lock;
+
+    image_shm_name(datadir, name);
+    dict = image_attach_segment(datadir, name);
+    if (dict || (errno != ESTALE && errno != EINVAL)) {
+        return dict;
+    }
+    if (errno == ESTALE) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // Wait for a publisher still filling the segment, then look again
+    lock = image_shm_lock(datadir, LOCK_SH);
+    if (lock < 0) {
+        return NULL;
+    }
+    dict = image_attach_segment(datadir, name);
+    if (!dict && (errno == ESTALE || errno == EINVAL)) {
+        // Nobody can be publishing while we hold the lock
+        shm_unlink(name);
+    }
+    close(lock);
+    return dict;
+}
+
+/**
+ * Publish a dictionary image in shared memory
+ *
+ * The segment is filled under the publishing lock of the data directory,
+ * and the magic number is stored last. Until then, processes attaching to
+ * the segment wait for the lock (see image_attach).
+ *
+ * Segments are named /dev/shm/jdtalk-<version>-<uid>-<hash of datadir>, and
+ * outlive every process using them. Removing one is always safe: the next
+ * process started with --shared-dict publishes it again.
+ *
+ * @param dict pointer to populated and indexed dictionary
+ * @param datadir path to raw dictionary files the dictionary was loaded from
+ * @return 0=success, -1=failure (errno is set, EEXIST=another process published first)
+ */
+int image_publish(struct Dictionary *dict, const char *datadir) {
+    struct DictionaryImageHeader *hdr;
+    char name[NAME_MAX];
+    uint64_t size;
+    char *image;
+    char *shared;
+    int lock;
+    int fd;
+
+    image = image_build(dict, datadir, &size);
+    if (!image) {
+        return -1;
+    }
+    hdr = (struct DictionaryImageHeader *) image;
+
+    image_shm_name(datadir, name);
+    lock = image_shm_lock(datadir, LOCK_EX);
+    if (lock < 0) {
+        int err = errno;
+        free(image);
+        errno = err;
+        return -1;
+    }
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        int err = errno;
+        close(lock);
+        free(image);
+        errno = err;
+        return -1;
+    }
+    if (ftruncate(fd, (off_t) size) < 0
+        || (shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        shm_unlink(name);
+        close(lock);
+        free(image);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+
+    memcpy(shared + sizeof(hdr->magic), image + sizeof(hdr->magic), size - sizeof(hdr->magic));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shared, hdr->magic, sizeof(hdr->magic));
+    munmap(shared, size);
+    close(lock);
+    free(image);
+    return 0;
+}
+
+/**
+ * Release the image backing a dictionary
+ * @param dict pointer to dictionary
+ */
+void image_unmap(struct Dictionary *dict) {
+    if (dict->image && dict->image_size) {
+        munmap(dict->image, dict->image_size);
+        dict->image = NULL;
+        dict->image_size = 0;
+    }
+}
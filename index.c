@@ -0,0 +1,388 @@
+#include "jdtalk.h"
+
+#define INDEX_FNV_OFFSET 2166136261u
+#define INDEX_FNV_PRIME 16777619u
+#define INDEX_TRIGRAM_MAX (DICT_WORD_SIZE_MAX - 2)
+
+/**
+ * Hash a string (FNV-1a)
+ * @param s input string
+ * @param icase fold upper case characters to lower case before hashing
+ * @return hash of s
+ */
+static uint32_t index_hash(const char *s, int icase) {
+    uint32_t hash = INDEX_FNV_OFFSET;
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char) *s;
+        if (icase) {
+            ch = (unsigned char) tolower(ch);
+        }
+        hash ^= ch;
+        hash *= INDEX_FNV_PRIME;
+    }
+    // Zero marks an empty slot
+    return hash ? hash : 1;
+}
+
+/**
+ * Find the slot of a string in a hash table
+ *
+ * @param dict pointer to indexed dictionary
+ * @param table hash table to search (dict->hash or dict->hash_icase)
+ * @param s string to search for
+ * @param icase table is case-folded
+ * @return pointer to the matching slot, or the empty slot where s belongs (NULL=s is missing from a full table)
+ */
+static struct DictionaryHashSlot *index_slot(const struct Dictionary *dict, struct DictionaryHashSlot *table, const char *s, int icase) {
+    uint32_t hash;
+    size_t mask;
+    size_t i;
+
+    hash = index_hash(s, icase);
+    mask = dict->hash_size - 1;
+    i = hash & mask;
+    // Every slot is probed at most once, even if a table has no empty slot
+    for (size_t probes = 0; probes < dict->hash_size; probes++, i = (i + 1) & mask) {
+        const char *word;
+        if (!table[i].hash) {
+            return &table[i];
+        }
+        if (table[i].hash != hash) {
+            continue;
+        }
+        word = dictionary_at(dict, table[i].index);
+        if ((icase ? strcasecmp(word, s) : strcmp(word, s)) == 0) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get the first character of a word (letter group key)
+ * @param dict pointer to populated dictionary
+ * @param i word index
+ * @return group key
+ */
+static size_t index_key_letter(const struct Dictionary *dict, size_t i) {
+    return (unsigned char) *dictionary_at(dict, i);
+}
+
+/**
+ * Get the length of a word (length group key)
+ * @param dict pointer to populated dictionary
+ * @param i word index
+ * @return group key
+ */
+static size_t index_key_length(const struct Dictionary *dict, size_t i) {
+    return dict->nchar[i] < INDEX_LENGTH_BUCKETS - 1 ? dict->nchar[i] : INDEX_LENGTH_BUCKETS - 2;
+}
+
+/**
+ * Group the words of one type by a key (counting sort)
+ *
+ * @param dict pointer to populated dictionary
+ * @param type type of word (WT_ANY=all words)
+ * @param dest first slot of order receiving the group
+ * @param order array receiving word indexes
+ * @param start array receiving the start of each key (nbuckets per type)
+ * @param nbuckets number of keys plus one
+ * @param key function producing the key of a word
+ */
+static void index_build_groups(struct Dictionary *dict, unsigned type, size_t dest, uint32_t *order, uint32_t *start, size_t nbuckets, size_t (*key)(const struct Dictionary *, size_t)) {
+    const struct DictionaryRange *range = &dict->range[type];
+    uint32_t *next;
+
+    start += type * nbuckets;
+    memset(start, 0, nbuckets * sizeof(*start));
+    for (size_t i = range->base; i < range->base + range->count; i++) {
+        start[key(dict, i) + 1]++;
+    }
+    start[0] = (uint32_t) dest;
+    for (size_t c = 1; c < nbuckets; c++) {
+        start[c] += start[c - 1];
+    }
+
+    next = malloc(nbuckets * sizeof(*next));
+    if (!next) {
+        perror("Unable to allocate dictionary index");
+        exit(1);
+    }
+    memcpy(next, start, nbuckets * sizeof(*next));
+    for (size_t i = range->base; i < range->base + range->count; i++) {
+        order[next[key(dict, i)]++] = (uint32_t) i;
+    }
+    free(next);
+}
+
+/**
+ * Hash three characters into a trigram bucket
+ * @param s at least three characters
+ * @return bucket number
+ */
+static uint32_t index_trigram_key(const char *s) {
+    uint32_t x = ((uint32_t) (unsigned char) s[0] << 16)
+               | ((uint32_t) (unsigned char) s[1] << 8)
+               | (uint32_t) (unsigned char) s[2];
+    return (x * 2654435761u) >> (32 - INDEX_TRIGRAM_BITS);
+}
+
+/**
+ * Collect the distinct trigram buckets of a word
+ * @param word word
+ * @param nchar length of word
+ * @param keys array receiving the buckets (INDEX_TRIGRAM_MAX)
+ * @return number of buckets
+ */
+static size_t index_trigram_keys(const char *word, size_t nchar, uint32_t *keys) {
+    size_t nkeys = 0;
+    for (size_t i = 0; i + 3 <= nchar && nkeys < INDEX_TRIGRAM_MAX; i++) {
+        uint32_t key = index_trigram_key(&word[i]);
+        size_t k;
+        for (k = 0; k < nkeys && keys[k] != key; k++);
+        if (k == nkeys) {
+            keys[nkeys++] = key;
+        }
+    }
+    return nkeys;
+}
+
+/**
+ * Group the words of a dictionary by the trigrams they contain
+ *
+ * Trigrams are hashed into INDEX_TRIGRAM_BUCKETS - 1 buckets. Each bucket
+ * lists every word holding one of its trigrams, in dictionary order.
+ *
+ * @param dict pointer to populated dictionary
+ */
+static void index_build_trigrams(struct Dictionary *dict) {
+    uint32_t keys[INDEX_TRIGRAM_MAX];
+    uint32_t *next;
+    size_t total;
+
+    dict->trigram_start = calloc(INDEX_TRIGRAM_BUCKETS, sizeof(*dict->trigram_start));
+    next = malloc(INDEX_TRIGRAM_BUCKETS * sizeof(*next));
+    if (!dict->trigram_start || !next) {
+        perror("Unable to allocate dictionary trigram index");
+        exit(1);
+    }
+
+    total = 0;
+    for (size_t i = 0; i < dict->nelem_inuse; i++) {
+        size_t nkeys = index_trigram_keys(dictionary_at(dict, i), dict->nchar[i], keys);
+        for (size_t k = 0; k < nkeys; k++) {
+            dict->trigram_start[keys[k] + 1]++;
+        }
+        total += nkeys;
+    }
+    for (size_t b = 1; b < INDEX_TRIGRAM_BUCKETS; b++) {
+        dict->trigram_start[b] += dict->trigram_start[b - 1];
+    }
+
+    dict->trigram = malloc(total * sizeof(*dict->trigram) + 1);
+    if (!dict->trigram) {
+        perror("Unable to allocate dictionary trigram index");
+        exit(1);
+    }
+    dict->trigram_size = total;
+    memcpy(next, dict->trigram_start, INDEX_TRIGRAM_BUCKETS * sizeof(*next));
+    for (size_t i = 0; i < dict->nelem_inuse; i++) {
+        size_t nkeys = index_trigram_keys(dictionary_at(dict, i), dict->nchar[i], keys);
+        for (size_t k = 0; k < nkeys; k++) {
+            dict->trigram[next[keys[k]]++] = (uint32_t) i;
+        }
+    }
+    free(next);
+}
+
+/**
+ * Build the word lookup tables of a dictionary
+ *
+ * Each unique word maps to a bitmask of its types (1 << WT_*). A second
+ * table does the same for case-folded words.
+ *
+ * Words are also grouped by type and first character, and by type and
+ * length, so a word of a given type beginning with a given character
+ * (see index_letter) or no longer than a given length (see index_length)
+ * is a single draw. Words are also grouped by the trigrams they contain
+ * (see index_substring).
+ *
+ * @param dict pointer to populated dictionary
+ */
+void index_build(struct Dictionary *dict) {
+    uint64_t start = bench_now();
+    size_t size;
+
+    // Keep the load factor at or below 0.75
+    size = 1;
+    while (size < dict->nelem_inuse + dict->nelem_inuse / 3 + 1) {
+        size <<= 1;
+    }
+    dict->hash_size = size;
+    dict->hash = calloc(size, sizeof(*dict->hash));
+    dict->hash_icase = calloc(size, sizeof(*dict->hash_icase));
+    if (!dict->hash || !dict->hash_icase) {
+        perror("Unable to allocate dictionary index");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < dict->nelem_inuse; i++) {
+        const char *word = dictionary_at(dict, i);
+        struct DictionaryHashSlot *slot;
+
+        slot = index_slot(dict, dict->hash, word, 0);
+        if (!slot->hash) {
+            slot->hash = index_hash(word, 0);
+            slot->index = (uint32_t) i;
+        }
+        slot->types |= 1u << dict->type[i];
+
+        slot = index_slot(dict, dict->hash_icase, word, 1);
+        if (!slot->hash) {
+            slot->hash = index_hash(word, 1);
+            slot->index = (uint32_t) i;
+        }
+        slot->types |= 1u << dict->type[i];
+    }
+
+    // All words, followed by the words of each type at their own positions
+    dict->letter = malloc(2 * dict->nelem_inuse * sizeof(*dict->letter) + 1);
+    dict->letter_start = malloc((WT_VERB + 1) * INDEX_LETTER_BUCKETS * sizeof(*dict->letter_start));
+    dict->length = malloc(2 * dict->nelem_inuse * sizeof(*dict->length) + 1);
+    dict->length_start = malloc((WT_VERB + 1) * INDEX_LENGTH_BUCKETS * sizeof(*dict->length_start));
+    if (!dict->letter || !dict->letter_start || !dict->length || !dict->length_start) {
+        perror("Unable to allocate dictionary index");
+        exit(1);
+    }
+    for (unsigned type = WT_ANY; type <= WT_VERB; type++) {
+        size_t dest = type == WT_ANY ? 0 : dict->nelem_inuse + dict->range[type].base;
+        index_build_groups(dict, type, dest, dict->letter, dict->letter_start, INDEX_LETTER_BUCKETS, index_key_letter);
+        index_build_groups(dict, type, dest, dict->length, dict->length_start, INDEX_LENGTH_BUCKETS, index_key_length);
+    }
+    index_build_trigrams(dict);
+    dict->index_time = bench_now() - start;
+}
+
+/**
+ * Get the words of a type beginning with a character
+ *
+ * @param dict pointer to indexed dictionary
+ * @param type type of word (WT_ANY=all words)
+ * @param ch first character
+ * @param count receives the number of words
+ * @return pointer to count word indexes
+ */
+const uint32_t *index_letter(const struct Dictionary *dict, unsigned type, char ch, size_t *count) {
+    const uint32_t *start = &dict->letter_start[type * INDEX_LETTER_BUCKETS + (unsigned char) ch];
+    *count = start[1] - start[0];
+    return &dict->letter[start[0]];
+}
+
+/**
+ * Get the words of a type no longer than a length
+ *
+ * @param dict pointer to indexed dictionary
+ * @param type type of word (WT_ANY=all words)
+ * @param maxlen maximum length of each word
+ * @param count receives the number of words
+ * @return pointer to count word indexes
+ */
+const uint32_t *index_length(const struct Dictionary *dict, unsigned type, size_t maxlen, size_t *count) {
+    const uint32_t *start = &dict->length_start[type * INDEX_LENGTH_BUCKETS];
+    if (maxlen > INDEX_LENGTH_BUCKETS - 2) {
+        maxlen = INDEX_LENGTH_BUCKETS - 2;
+    }
+    *count = start[maxlen + 1] - start[0];
+    return &dict->length[start[0]];
+}
+
+/**
+ * Find every word containing a string
+ *
+ * The words listed in the trigram bucket of each trigram of s are
+ * candidates. Only the smallest bucket is checked. Strings shorter than
+ * a trigram are searched for in every word.
+ *
+ * @param dict pointer to indexed dictionary
+ * @param s string to search for (case-sensitive)
+ * @param count receives the number of words
+ * @return array of word indexes in dictionary order (free it), or NULL if no word contains s
+ */
+uint32_t *index_substring(const struct Dictionary *dict, const char *s, size_t *count) {
+    const uint32_t *candidate;
+    size_t ncandidate;
+    uint32_t *result;
+    size_t len;
+
+    *count = 0;
+    len = strlen(s);
+    candidate = NULL;
+    ncandidate = dict->nelem_inuse;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        uint32_t key = index_trigram_key(&s[i]);
+        size_t n = dict->trigram_start[key + 1] - dict->trigram_start[key];
+        if (!candidate || n < ncandidate) {
+            candidate = &dict->trigram[dict->trigram_start[key]];
+            ncandidate = n;
+        }
+    }
+    if (!ncandidate) {
+        return NULL;
+    }
+
+    result = malloc(ncandidate * sizeof(*result));
+    if (!result) {
+        perror("Unable to allocate substring matches");
+        exit(1);
+    }
+    for (size_t i = 0; i < ncandidate; i++) {
+        uint32_t index = candidate ? candidate[i] : (uint32_t) i;
+        if (dict->nchar[index] >= len && strstr(dictionary_at(dict, index), s)) {
+            result[(*count)++] = index;
+        }
+    }
+    if (!*count) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+/**
+ * Look up the types of a word
+ *
+ * @param dict pointer to indexed dictionary
+ * @param s word to search for
+ * @param icase case-insensitive search
+ * @return bitmask of word types (1 << WT_*), 0=not found
+ */
+unsigned index_lookup(const struct Dictionary *dict, const char *s, int icase) {
+    const struct DictionaryHashSlot *slot;
+    slot = index_slot(dict, icase ? dict->hash_icase : dict->hash, s, icase);
+    return slot ? slot->types : 0;
+}
+
+/**
+ * Release the lookup tables of a dictionary
+ * @param dict pointer to dictionary
+ */
+void index_free(struct Dictionary *dict) {
+    free(dict->hash);
+    free(dict->hash_icase);
+    free(dict->letter);
+    free(dict->letter_start);
+    free(dict->length);
+    free(dict->length_start);
+    free(dict->trigram);
+    free(dict->trigram_start);
+    dict->hash = NULL;
+    dict->hash_icase = NULL;
+    dict->hash_size = 0;
+    dict->letter = NULL;
+    dict->letter_start = NULL;
+    dict->length = NULL;
+    dict->length_start = NULL;
+    dict->trigram = NULL;
+    dict->trigram_start = NULL;
+    dict->trigram_size = 0;
+}
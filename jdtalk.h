@@ -8,14 +8,60 @@
 #include <errno.h>
 #include <ctype.h>
 #include <limits.h>
+#include <stdint.h>
 
 #define DICT_INITIAL_SIZE 65535
 #define DICT_WORD_SIZE_MAX 255
+#define DICT_WORD_LEN_MAX (DICT_WORD_SIZE_MAX - 2)
 #define INPUT_SIZE_MAX 255
 #define OUTPUT_PART_MAX 255
 #define OUTPUT_SIZE_MAX 1024
+#define STRBUF_INITIAL_SIZE 256
 
 #define DEFAULT_FORMAT "andv"
+#define STR_RANDOM_CASE (1 << 0)
+#define STR_HILL_CASE (1 << 1)
+#define STR_LEET (1 << 2)
+#define STR_TITLE_CASE (1 << 3)
+#define STR_SHUFFLE (1 << 4)
+#define STR_REVERSE (1 << 5)
+#define STR_LEET_MAX 4
+#define FORMAT_OPS_INITIAL 16
+#define FORMAT_OPS_MAX 65536
+#define GENERATE_CHUNK_LINES 256
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+#define SERVER_BACKLOG 64
+#define SERVER_BUFFER_SIZE 4096
+#define SERVER_REQUEST_MAX (64 * 1024)
+#define SERVER_ARGS_MAX 256
+#define SERVER_ACCEPT_BACKOFF_MS 100
+#define CACHE_DEPTH_DEFAULT 1024
+#define CACHE_SHAPES_MAX 32
+#define CACHE_LINE_SIZE 64
+#define BENCH_LOAD 0
+#define BENCH_INDEX 1
+#define BENCH_GENERATE 2
+#define BENCH_TRANSFORM 3
+#define BENCH_OUTPUT 4
+#define BENCH_PHASES 5
+#define BENCH_SUB_BUCKETS 16
+#define BENCH_BUCKETS (61 * BENCH_SUB_BUCKETS)
+
+#define OUTPUT_AUTO 0
+#define OUTPUT_LINE 1
+#define OUTPUT_BULK 2
+
+#define DICT_IMAGE_NAME "jdtalk.dict"
+#define DICT_IMAGE_MAGIC "JDTALKD"
+#define DICT_IMAGE_VERSION 5
+#define DICT_IMAGE_ENDIAN 0x01020304
+#define DICT_SOURCE_MAX 4
+#define DICT_SHM_WAIT_MS 5000
+#define INDEX_LETTER_BUCKETS 257
+#define INDEX_LENGTH_BUCKETS (DICT_WORD_SIZE_MAX + 1)
+#define TALK_POOL_MAX 3
+#define INDEX_TRIGRAM_BITS 16
+#define INDEX_TRIGRAM_BUCKETS ((1 << INDEX_TRIGRAM_BITS) + 1)
 
 #define WT_ICASE 0x80
 #define WT_ANY 0
@@ -23,51 +69,440 @@
 #define WT_ADJECTIVE 2
 #define WT_ADVERB 3
 #define WT_VERB 4
+#define DICT_TYPES_ALL ((1U << WT_NOUN) | (1U << WT_ADJECTIVE) | (1U << WT_ADVERB) | (1U << WT_VERB))
 
-#define JSON_BEGIN(FP) fprintf(FP, "{\n")
-#define JSON_INDENT(FP, LEVEL) for (size_t indenter = 0; indenter < LEVEL; indenter++) { fprintf(FP, "  "); }
-#define JSON_NEXT_ITEM(FP) fprintf(FP, ",\n")
-#define JSON_NEXT_LINE(FP) fprintf(FP, "\n")
-#define JSON_LIST_BEGIN(FP, KEY) JSON_INDENT(FP, 1); fprintf(FP, "\"%s\": [", KEY)
-#define JSON_LIST_APPEND(FP, VALUE) JSON_INDENT(FP, 2); fprintf(FP, "\"%s\"", VALUE)
-#define JSON_LIST_END(FP) fprintf(FP, "]")
-#define JSON_STRING(FP, KEY, VALUE) JSON_INDENT(FP, 1); fprintf(FP, "\"%s\": \"%s\"", KEY, VALUE)
-#define JSON_END(FP) fprintf(FP, "}\n")
-
-struct Word {
-    char *word;
-    unsigned type;
-    size_t nchar;
+#define JSON_DEPTH_MAX 16
+
+// Random number generator state (xoshiro256**)
+struct Rng {
+    uint64_t s[4];
+};
+
+// String builder (growable, or over caller-owned storage)
+struct StrBuf {
+    char *data;
+    size_t len;             // length of string in data
+    size_t size;            // size of data in bytes
+    int owned;              // data is heap allocated and grows as needed
+    int truncated;          // an append did not fit
+};
+
+// Characters of a batch of lines to convert to upper case
+struct StrCase {
+    uint64_t *bits;         // one bit per byte of the batch
+    size_t nwords_alloc;
+    size_t len;             // length of batch in bytes
+    unsigned flags;         // STR_RANDOM_CASE, STR_HILL_CASE and/or STR_TITLE_CASE
+};
+
+// Measurements of a run (see bench_report)
+struct Bench {
+    uint64_t total;                 // nanoseconds from loading the dictionary to the last write
+    uint64_t run;                   // nanoseconds spent producing output
+    uint64_t phase[BENCH_PHASES];   // nanoseconds spent in each phase (BENCH_*)
+    uint64_t lines;                 // lines produced
+    uint64_t bytes;                 // bytes produced
+    uint64_t rejected;              // phrases rejected by the search pattern
+    uint64_t redrawn;               // words drawn again to keep the planted word first
+    uint64_t latency[BENCH_BUCKETS]; // histogram of line latencies (see bench_latency)
+};
+
+// Buffered output stream
+struct Output {
+    int fd;
+    int mode;               // OUTPUT_LINE=flush after each line, OUTPUT_BULK=flush when full
+    char *buf;
+    size_t len;
+    size_t size;
+    int error;              // errno of the first failed write
+};
+
+// Word lookup table entry
+struct DictionaryHashSlot {
+    uint32_t hash;          // hash of word (0=empty slot)
+    uint32_t index;         // first occurrence of word in the dictionary
+    uint32_t types;         // bitmask of word types (1 << WT_*)
+};
+
+// Contiguous run of words in a dictionary
+struct DictionaryRange {
+    uint32_t base;
+    uint32_t count;
 };
 
 struct Dictionary {
-    struct Word **words;
+    char *arena;            // NUL terminated words, back to back
+    uint32_t *offset;       // offset of each word in arena
+    uint32_t *nchar;        // length of each word
+    uint8_t *type;          // type of each word
     size_t nelem_alloc;
     size_t nelem_inuse;
+    size_t arena_alloc;
+    size_t arena_inuse;
+    struct DictionaryHashSlot *hash;        // exact word lookup table
+    struct DictionaryHashSlot *hash_icase;  // case-folded word lookup table
+    size_t hash_size;       // slots per lookup table (power of two)
+    struct DictionaryRange range[WT_VERB + 1];  // words of each type (WT_ANY=all words)
+    uint32_t *letter;       // word indexes grouped by type, then by first character
+    uint32_t *letter_start; // start of each (type, first character) group in letter
+    uint32_t *length;       // word indexes grouped by type, then by length
+    uint32_t *length_start; // start of each (type, length) group in length
+    uint32_t *trigram;      // word indexes grouped by the trigrams they contain
+    uint32_t *trigram_start; // start of each trigram bucket in trigram
+    size_t trigram_size;    // number of word indexes in trigram
+    uint64_t index_time;    // nanoseconds spent building the indexes (0=loaded prebuilt)
+    void *image;            // read-only compiled image (NULL for text dictionaries)
+    size_t image_size;      // size of image mapping (0=image is built into the program)
+};
+
+// Zero-copy slice of a dictionary holding one type of word
+struct DictionaryView {
+    const struct Dictionary *dict;
+    size_t base;
+    size_t count;
+    unsigned type;
+};
+
+// Source of the words of one position of a phrase
+struct TalkPool {
+    int type;               // type of word (WT_*), or -1 to draw from list
+    int letter;             // required first character (-1=any)
+    size_t maxlen;          // maximum length of each word (0=any)
+    double weight;          // probability of drawing from this pool
+    const char *const *list; // fixed words (type=-1)
+    size_t nlist;           // number of fixed words
+};
+
+// Words satisfying the search pattern in one position of a phrase
+struct TalkPlantSlot {
+    double chance;                              // probability of a random word satisfying the pattern
+    size_t ngroups;                             // number of groups
+    double weight[TALK_POOL_MAX];               // cumulative probability of each group, given a match
+    const char **words[TALK_POOL_MAX];          // words of each group satisfying the pattern
+    size_t count[TALK_POOL_MAX];                // number of words of each group
+};
+
+// Search pattern planted in one position of every phrase (see generate_plant)
+struct TalkPlant {
+    const char *pattern;    // search pattern
+    int exact;              // 0=a word contains pattern, 1=a word equals pattern
+    size_t *slot;           // words satisfying pattern in each position (index of config)
+    double *first;          // cumulative probability of each position being the first to satisfy pattern
+    size_t nslots;          // number of positions in a phrase
+    struct TalkPlantSlot *config;       // distinct positions (storage of slot)
+    size_t nconfig;         // number of distinct positions
+};
+
+// One token of a compiled output format
+struct FormatOp {
+    const struct DictionaryView *view;  // words to draw from (NULL=literal)
+    const char *literal;                // literal text
+    size_t len;                         // length of literal, or average length of words
+    char ch;                            // format character (0=literal)
+};
+
+// Compiled output format (see format_compile)
+struct Format {
+    struct FormatOp *op;    // tokens in output order (repeats expanded)
+    size_t nops;            // number of tokens
+    size_t nops_alloc;      // number of tokens allocated
+    size_t expected;        // expected length of a phrase
+    char *storage;          // literal text of every token
+};
+
+// Generator context (one per thread)
+struct Talk {
+    const struct DictionaryView *view;  // dictionary views indexed by word type (shared, read-only)
+    struct Rng *rng;                    // random number generator (not shared)
+    const struct TalkPlant *plant;      // word planted in each phrase (NULL=none, shared, read-only)
+    size_t plant_slot;                  // position receiving the planted word in the current phrase
+    size_t redrawn;                     // words drawn again to keep the planted word first
 };
 
-struct Dictionary *dictionary_new();
-void dictionary_append(struct Dictionary **dict, char *s, unsigned type);
-int dictionary_read(FILE *fp, struct Dictionary **dict, unsigned type);
-struct Dictionary *dictionary_populate();
-unsigned dictionary_contains(struct Dictionary *dict[], const char *s, unsigned type);
-char *dictionary_word(struct Dictionary *dict, unsigned type);
+// Command line settings
+struct Options {
+    const char *format;
+    const struct Format *plan;  // compiled format
+    const char *pattern;
+    const char *acronym;
+    int do_pattern;
+    int do_exact;
+    int do_acronym;
+    int do_random_case;
+    int do_hill_case;
+    int do_leet;
+    int do_salad;
+    int do_benchmark;
+    int do_title_case;
+    int do_shuffle;
+    int do_reverse;
+    int do_format;
+    int do_heart;
+    int do_json;
+    int do_ndjson;          // write one compact JSON object per line
+    int do_parts;           // include the words of each line and their types in JSON output
+    int do_compile;
+    int do_unordered;
+    int do_usage;           // show the usage statement
+    int do_seed;            // the seed was given
+    int do_cache_stats;     // report the phrase cache of the server
+    int do_shared_dict;     // share the loaded dictionary with other processes
+    const char *serve;      // path of the socket to serve requests on (NULL=generate)
+    size_t workers;         // number of requests served at once (0=one per processor)
+    size_t cache_depth;     // phrases cached per request shape (0=no cache)
+    size_t cache_low;       // refill a cache ring below this many phrases (0=default)
+    size_t cache_high;      // stop refilling once this many phrases are ready (0=default)
+    size_t limit;           // number of lines to produce (0=unlimited)
+    size_t salad_limit;
+    size_t heart_limit;
+    size_t heart_maxlen;
+    size_t threads;         // number of worker threads (0=generate in the calling thread)
+    uint64_t seed;
+};
+
+struct Cache;
+struct CacheShape;
+
+// One run of the generator (a command line, or a request to the server)
+struct Request {
+    struct Options opt;
+    struct Format format;               // compiled opt.format
+    int compiled;                       // format is compiled
+    struct TalkPlant plant;
+    const struct TalkPlant *plant_ptr;  // plant of the search pattern (NULL=none)
+    struct Bench *bench;                // receives measurements of the run (NULL=don't measure)
+};
+
+// Scratch space for producing chunks of lines (one per thread)
+struct GenerateBatch {
+    struct StrBuf line;     // current line
+    struct StrBuf phrase;   // current phrase before transformation
+    struct StrBuf chunk;    // newline terminated lines
+    struct StrCase upper;   // case conversion applied to the whole chunk
+    int batch_case;         // transformations only change case (see str_case_batchable)
+    const char **parts;
+    size_t parts_max;
+    const char **line_parts;    // words of each line of the chunk, NULL after each line (see keep_parts)
+    size_t line_parts_len;
+    size_t line_parts_alloc;
+    int keep_parts;             // record the words of each line of the chunk
+    struct Bench *bench;    // receives measurements of each line (NULL=don't measure)
+};
+
+// Receives a block of newline terminated lines from generate_parallel (returns -1 to stop generating)
+// parts holds the words of each line, NULL after each line (NULL=not kept)
+typedef int (*generate_emit_fn)(void *arg, const char *lines, size_t len, const char *const *parts, size_t nlines);
+
+// Streaming JSON encoder writing into an output stream
+struct Json {
+    struct Output *out;
+    int pretty;                     // one value per line, indented (0=compact)
+    size_t depth;                   // number of open objects and arrays
+    size_t count[JSON_DEPTH_MAX];   // values written in each open object or array
+    int keyed;                      // a key is waiting for its value
+};
+
+/**
+ * Get a word from a dictionary
+ * @param dict pointer to dictionary
+ * @param index position of word
+ * @return pointer to word (don't free it)
+ */
+static inline char *dictionary_at(const struct Dictionary *dict, size_t index) {
+    return dict->arena + dict->offset[index];
+}
+
+// Identity of a raw dictionary file at the time an image was compiled
+struct DictionarySource {
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+// Compiled dictionary image layout (all offsets are relative to the start of the image)
+enum DictionaryImageSectionId {
+    DICT_SECTION_STRINGS = 1,   // NUL terminated words, back to back
+    DICT_SECTION_OFFSETS,       // uint32_t offset of each word in DICT_SECTION_STRINGS
+    DICT_SECTION_LENGTHS,       // uint32_t length of each word
+    DICT_SECTION_TYPES,         // uint8_t type of each word
+    DICT_SECTION_RANGES,        // struct DictionaryRange for each word type
+    DICT_SECTION_HASH,          // struct DictionaryHashSlot exact lookup table
+    DICT_SECTION_HASH_ICASE,    // struct DictionaryHashSlot case-folded lookup table
+    DICT_SECTION_LETTER,        // uint32_t word indexes grouped by type and first character
+    DICT_SECTION_LETTER_START,  // uint32_t start of each group in DICT_SECTION_LETTER
+    DICT_SECTION_LENGTH,        // uint32_t word indexes grouped by type and length
+    DICT_SECTION_LENGTH_START,  // uint32_t start of each group in DICT_SECTION_LENGTH
+    DICT_SECTION_TRIGRAM,       // uint32_t word indexes grouped by trigram bucket
+    DICT_SECTION_TRIGRAM_START, // uint32_t start of each bucket in DICT_SECTION_TRIGRAM
+    DICT_SECTION_MAX,
+};
+
+struct DictionaryImageSection {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct DictionaryImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t size;
+    uint64_t nelem;
+    struct DictionarySource sources[DICT_SOURCE_MAX];
+    uint32_t nsections;
+    uint32_t reserved;
+    struct DictionaryImageSection sections[DICT_SECTION_MAX];
+};
+
+extern const char *dictionary_files[];
+extern const char *const image_embedded_data;
+extern const size_t image_embedded_size;
+extern const unsigned dictionary_files_type[];
+
+struct Dictionary *dictionary_populate(unsigned types);
+struct Dictionary *dictionary_populate_shared();
+struct Dictionary *dictionary_populate_text(const char *datadir, unsigned types);
+const char *dictionary_datadir();
+int dictionary_sources(const char *datadir, struct DictionarySource sources[]);
+unsigned dictionary_contains(const struct Dictionary *dict, const char *s, unsigned type);
+char *dictionary_word(const struct DictionaryView *view, struct Rng *rng);
+const char *dictionary_word_len(const struct DictionaryView *view, struct Rng *rng, size_t *len);
+char *dictionary_word_letter(const struct DictionaryView *view, char ch, struct Rng *rng);
+size_t dictionary_count_short(const struct DictionaryView *view, size_t maxlen);
+char *dictionary_word_short(const struct DictionaryView *view, size_t maxlen, struct Rng *rng);
+char dictionary_type_format(unsigned type);
 char *dictionary_word_formats(struct Dictionary *dict, const char *s);
-struct Dictionary *dictionary_of(struct Dictionary **src, unsigned type);
+int dictionary_word_type(const struct Dictionary *dict, const char *word);
+int dictionary_word_formats_r(const struct Dictionary *dict, const char *s, struct StrBuf *out);
+struct DictionaryView dictionary_view(const struct Dictionary *dict, unsigned type);
 void dictionary_free(struct Dictionary *dict);
 
-char *str_random_case(char *s);
+void index_build(struct Dictionary *dict);
+unsigned index_lookup(const struct Dictionary *dict, const char *s, int icase);
+const uint32_t *index_letter(const struct Dictionary *dict, unsigned type, char ch, size_t *count);
+const uint32_t *index_length(const struct Dictionary *dict, unsigned type, size_t maxlen, size_t *count);
+uint32_t *index_substring(const struct Dictionary *dict, const char *s, size_t *count);
+void index_free(struct Dictionary *dict);
+
+int image_write(struct Dictionary *dict, const char *datadir, const char *filename);
+int image_write_source(struct Dictionary *dict, const char *datadir, const char *filename);
+struct Dictionary *image_load(const char *datadir, const char *filename);
+struct Dictionary *image_embedded();
+struct Dictionary *image_attach(const char *datadir);
+int image_publish(struct Dictionary *dict, const char *datadir);
+void image_unmap(struct Dictionary *dict);
+
+void strbuf_init(struct StrBuf *sb, char *storage, size_t size);
+void strbuf_new(struct StrBuf *sb, size_t size);
+void strbuf_free(struct StrBuf *sb);
+int strbuf_reserve(struct StrBuf *sb, size_t n);
+void strbuf_clear(struct StrBuf *sb);
+int strbuf_append(struct StrBuf *sb, const char *s, size_t n);
+int strbuf_puts(struct StrBuf *sb, const char *s);
+int strbuf_putc(struct StrBuf *sb, char ch);
+int strbuf_printf(struct StrBuf *sb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void output_init(struct Output *out, int fd, int mode);
+int output_write(struct Output *out, const char *s, size_t n);
+int output_puts(struct Output *out, const char *s);
+int output_line(struct Output *out, const char *s, size_t n);
+int output_printf(struct Output *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int output_flush(struct Output *out);
+int output_close(struct Output *out);
+void json_init(struct Json *json, struct Output *out, int pretty);
+int json_escape(struct Output *out, const char *s, size_t len);
+void json_object_begin(struct Json *json);
+void json_object_end(struct Json *json);
+void json_array_begin(struct Json *json);
+void json_array_end(struct Json *json);
+void json_key(struct Json *json, const char *key);
+void json_string(struct Json *json, const char *s, size_t len);
+void json_uint(struct Json *json, uint64_t value);
+void json_double(struct Json *json, double value, int precision);
+void json_null(struct Json *json);
+
+uint64_t bench_now();
+void bench_init(struct Bench *bench);
+void bench_latency(struct Bench *bench, uint64_t ns);
+uint64_t bench_percentile(const struct Bench *bench, double percentile);
+void bench_merge(struct Bench *dest, const struct Bench *src);
+void bench_report(const struct Bench *bench, const struct Options *opt, struct Output *out, int json);
+
+void rng_seed(struct Rng *rng, uint64_t seed);
+void rng_seed_stream(struct Rng *rng, uint64_t seed, uint64_t stream);
+uint64_t rng_seed_default();
+uint64_t rng_next(struct Rng *rng);
+uint32_t rng_bounded(struct Rng *rng, uint32_t n);
+
+char *str_random_case(char *s, struct Rng *rng);
 char *str_hill_case(char *s);
 char *str_leet(char *s);
+int str_leet_r(const char *s, struct StrBuf *out);
 char *str_title_case(char *s);
-char *str_randomize_words(char *s);
+char *str_randomize_words(char *s, struct Rng *rng);
 char *str_reverse(char *s);
+int str_transform_r(const char *s, size_t len, unsigned flags, struct Rng *rng, struct StrBuf *out);
+int str_case_batchable(unsigned flags);
+void str_case_init(struct StrCase *sc, unsigned flags);
+void str_case_free(struct StrCase *sc);
+void str_case_clear(struct StrCase *sc);
+void str_case_line(struct StrCase *sc, size_t pos, size_t len, struct Rng *rng);
+void str_case_apply(const struct StrCase *sc, char *s, size_t len);
+
+void talk_init(struct Talk *ctx, const struct DictionaryView *view, struct Rng *rng);
+int talk_plan_r(struct Talk *ctx, const struct Format *plan, struct StrBuf *out, const char **parts, size_t parts_max);
+int talkf_r(struct Talk *ctx, const char *fmt, struct StrBuf *out, const char **parts, size_t parts_max);
+void talk_plant_choose(struct Talk *ctx);
+int talk_plant_satisfies(const struct TalkPlant *plant, const char *word);
+size_t talk_format_pools(const struct FormatOp *op, struct TalkPool *pool);
+size_t talk_heart_pools(const struct DictionaryView *view, size_t word_maxlen, size_t slot, struct TalkPool *pool);
+size_t talk_acronym_pools(const struct Format *plan, const char *s, size_t slot, struct TalkPool *pool);
+int talk_salad_r(struct Talk *ctx, size_t limit, struct StrBuf *out, const char **parts, size_t parts_max);
+int talk_heart_r(struct Talk *ctx, size_t word_limit, size_t word_maxlen, struct StrBuf *out, const char **parts, size_t parts_max);
+int talk_acronym_r(struct Talk *ctx, const struct Format *plan, const char *s, struct StrBuf *out, const char **parts, size_t parts_max);
+char *talkf(struct DictionaryView dict[], struct Rng *rng, char *fmt, const char **parts, size_t parts_max);
+char *talk_salad(struct DictionaryView dict[], struct Rng *rng, size_t limit, const char **parts, size_t parts_max);
+char *talk_heart(struct DictionaryView dict[], struct Rng *rng, size_t word_limit, size_t word_maxlen, const char **parts, size_t parts_max);
+char *talk_acronym(struct DictionaryView dict[], struct Rng *rng, char *fmt, char *s, const char **parts, size_t parts_max);
+int generate_match(const struct Options *opt, const char *line, const char **parts, size_t nparts);
+unsigned generate_transforms(const struct Options *opt);
+size_t generate_parts_max(const struct Options *opt);
+size_t generate_line(struct Talk *ctx, const struct Options *opt, struct StrBuf *out, struct StrBuf *phrase, const char **parts, size_t parts_max);
+void generate_batch_init(struct GenerateBatch *batch, const struct Options *opt);
+void generate_batch_free(struct GenerateBatch *batch);
+size_t generate_chunk(struct Talk *ctx, const struct Options *opt, struct GenerateBatch *batch, size_t nlines);
+int generate_plant(struct TalkPlant *plant, const struct DictionaryView *view, const struct Options *opt);
+void generate_plant_free(struct TalkPlant *plant);
+int generate_parallel(const struct DictionaryView *view, const struct Options *opt, const struct TalkPlant *plant, generate_emit_fn emit, void *arg, struct Bench *bench);
+
+void request_usage(const char *name, struct StrBuf *sb);
+void request_init(struct Request *req);
+int request_parse(struct Request *req, int argc, char *argv[], struct StrBuf *errbuf);
+unsigned request_types(const struct Request *req);
+int request_json(const struct Request *req);
+int request_prepare(struct Request *req, const struct Dictionary *dict, const struct DictionaryView *view, struct StrBuf *errbuf);
+void request_error(const struct Request *req, struct Output *out, struct Output *err, const char *error);
+int request_run(const struct Request *req, const struct DictionaryView *view, struct CacheShape *shape, struct Output *out, struct StrBuf *errbuf);
+void request_free(struct Request *req);
+
+int server_run(const char *path, const struct Options *opt, const struct Dictionary *dict, const struct DictionaryView *view);
+int client_run(const char *path, int argc, char *argv[]);
+
+struct Cache *cache_new(size_t depth, size_t low, size_t high, const struct Dictionary *dict, const struct DictionaryView *view);
+struct CacheShape *cache_find(struct Cache *cache, const struct Request *req);
+int cache_take(struct CacheShape *shape, struct StrBuf *out);
+void cache_stats(struct Cache *cache, struct StrBuf *sb);
+void cache_free(struct Cache *cache);
 
-char *talkf(struct Dictionary *dict[], char *fmt, char **parts, size_t parts_max);
-char *talk_salad(struct Dictionary *dict[], size_t limit, char **parts, size_t parts_max);
-char *talk_heart(struct Dictionary *dict[], size_t word_limit, size_t word_maxlen, char **parts, size_t parts_max);
-char *talk_acronym(struct Dictionary *dict[], __attribute__((unused)) char *fmt, char *s, char **parts, size_t parts_max);
-int acronym_safe(struct Dictionary *dict, const char *acronym, const char *pattern, const char *fmt);
-int format_safe(char *s);
+int talk_format_type(char ch);
+int acronym_valid(const struct Format *plan, const char *acronym);
+int acronym_safe(const struct Dictionary *dict, const char *acronym, const char *pattern, const char *fmt);
+int format_compile(struct Format *plan, const char *fmt, const struct DictionaryView *view);
+unsigned format_types(const char *fmt);
+int format_has_literal(const struct Format *plan);
+char format_empty_view(const struct Format *plan);
+void format_free(struct Format *plan);
 
 #endif //JDTALKC_JDTALK_H
@@ -0,0 +1,197 @@
+#include "jdtalk.h"
+
+// Escape sequence of each byte in a JSON string (NULL=written as is)
+static const char *json_escapes[256] = {
+    "\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+    "\\b", "\\t", "\\n", "\\u000b", "\\f", "\\r", "\\u000e", "\\u000f",
+    "\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+    "\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+    ['"'] = "\\\"",
+    ['\\'] = "\\\\",
+    [0x7f] = "\\u007f",
+};
+
+static const char json_spaces[] = "                                ";
+
+/**
+ * Initialize a JSON encoder
+ *
+ * Pretty documents hold one value per line, indented by two spaces per
+ * level. Compact documents are written on a single line, which makes a
+ * series of them NDJSON.
+ *
+ * @param json pointer to encoder
+ * @param out pointer to output stream receiving the document
+ * @param pretty 0=compact, 1=pretty
+ */
+void json_init(struct Json *json, struct Output *out, int pretty) {
+    memset(json, 0, sizeof(*json));
+    json->out = out;
+    json->pretty = pretty;
+}
+
+/**
+ * Write a quoted JSON string
+ *
+ * Runs of bytes that need no escaping are copied into the output buffer
+ * in one piece. Bytes above 0x7f are copied as is (UTF-8 is assumed).
+ *
+ * @param out pointer to output stream
+ * @param s string
+ * @param len length of string
+ * @return 0=success, -1=the output failed
+ */
+int json_escape(struct Output *out, const char *s, size_t len) {
+    size_t run = 0;
+
+    output_write(out, "\"", 1);
+    for (size_t i = 0; i < len; i++) {
+        const char *escape = json_escapes[(unsigned char) s[i]];
+        if (!escape) {
+            continue;
+        }
+        output_write(out, s + run, i - run);
+        output_puts(out, escape);
+        run = i + 1;
+    }
+    output_write(out, s + run, len - run);
+    return output_write(out, "\"", 1);
+}
+
+/**
+ * Start a new line at the current depth (pretty documents only)
+ * @param json pointer to encoder
+ */
+static void json_indent(struct Json *json) {
+    size_t width = json->depth * 2;
+
+    if (!json->pretty) {
+        return;
+    }
+    output_write(json->out, "\n", 1);
+    while (width) {
+        size_t n = width < sizeof(json_spaces) - 1 ? width : sizeof(json_spaces) - 1;
+        output_write(json->out, json_spaces, n);
+        width -= n;
+    }
+}
+
+/**
+ * Separate a value from the previous one in its container
+ * @param json pointer to encoder
+ */
+static void json_next(struct Json *json) {
+    if (json->keyed) {
+        // The value follows its key
+        json->keyed = 0;
+        return;
+    }
+    if (!json->depth) {
+        return;
+    }
+    if (json->count[json->depth - 1]++) {
+        output_write(json->out, ",", 1);
+    }
+    json_indent(json);
+}
+
+/**
+ * Open an object or an array
+ * @param json pointer to encoder
+ * @param ch opening character
+ */
+static void json_open(struct Json *json, char ch) {
+    json_next(json);
+    output_write(json->out, &ch, 1);
+    if (json->depth >= JSON_DEPTH_MAX) {
+        fprintf(stderr, "JSON document is nested too deeply\n");
+        exit(1);
+    }
+    json->count[json->depth++] = 0;
+}
+
+/**
+ * Close an object or an array
+ *
+ * A closed top-level value ends the document with a newline.
+ *
+ * @param json pointer to encoder
+ * @param ch closing character
+ */
+static void json_close(struct Json *json, char ch) {
+    json->depth--;
+    json_indent(json);
+    output_write(json->out, &ch, 1);
+    if (!json->depth) {
+        output_write(json->out, "\n", 1);
+    }
+}
+
+void json_object_begin(struct Json *json) {
+    json_open(json, '{');
+}
+
+void json_object_end(struct Json *json) {
+    json_close(json, '}');
+}
+
+void json_array_begin(struct Json *json) {
+    json_open(json, '[');
+}
+
+void json_array_end(struct Json *json) {
+    json_close(json, ']');
+}
+
+/**
+ * Write the key of the next value of an object
+ * @param json pointer to encoder
+ * @param key key
+ */
+void json_key(struct Json *json, const char *key) {
+    json_next(json);
+    json_escape(json->out, key, strlen(key));
+    output_puts(json->out, json->pretty ? ": " : ":");
+    json->keyed = 1;
+}
+
+/**
+ * Write a string value
+ * @param json pointer to encoder
+ * @param s string
+ * @param len length of string
+ */
+void json_string(struct Json *json, const char *s, size_t len) {
+    json_next(json);
+    json_escape(json->out, s, len);
+}
+
+/**
+ * Write an unsigned integer value
+ * @param json pointer to encoder
+ * @param value value
+ */
+void json_uint(struct Json *json, uint64_t value) {
+    json_next(json);
+    output_printf(json->out, "%llu", (unsigned long long) value);
+}
+
+/**
+ * Write a number value
+ * @param json pointer to encoder
+ * @param value value
+ * @param precision number of decimal places
+ */
+void json_double(struct Json *json, double value, int precision) {
+    json_next(json);
+    output_printf(json->out, "%.*f", precision, value);
+}
+
+/**
+ * Write a null value
+ * @param json pointer to encoder
+ */
+void json_null(struct Json *json) {
+    json_next(json);
+    output_write(json->out, "null", 4);
+}
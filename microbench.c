@@ -0,0 +1,541 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include "jdtalk.h"
+
+#define MICROBENCH_SEED 0x6a647461UL
+#define MICROBENCH_SAMPLES 5
+#define MICROBENCH_WARMUP_NS 20000000ULL
+#define MICROBENCH_SAMPLE_MS 50
+#define MICROBENCH_THRESHOLD 10.0
+#define MICROBENCH_WORDS 1024
+#define MICROBENCH_LINES 20000
+#define MICROBENCH_ARGS_MAX 16
+
+// Inputs shared by the microbenchmarks
+struct MicrobenchFixture {
+    const struct Dictionary *dict;
+    const struct DictionaryView *view;
+    struct Rng rng;
+    struct Talk ctx;
+    struct Format acronym;          // compiled acronym format
+    struct StrBuf out;
+    const char *words[MICROBENCH_WORDS];    // words to look up (every fourth is missing)
+    char misses[MICROBENCH_WORDS / 4][DICT_WORD_SIZE_MAX];
+    const char *phrase;             // phrase to transform
+    char scratch[OUTPUT_SIZE_MAX];  // copy of phrase for in-place transformations
+    size_t sink;                    // results are summed, so the work can't be optimized away
+};
+
+// Performs a number of operations of a microbenchmark
+typedef void (*microbench_fn)(struct MicrobenchFixture *fx, size_t n);
+
+struct Microbench {
+    const char *name;
+    microbench_fn run;
+};
+
+// Measurement of one benchmark
+struct MicrobenchResult {
+    char name[64];
+    double ns_per_op;       // median of the samples
+    size_t iterations;      // operations per sample
+};
+
+// Command line of an end-to-end scenario (options of jdtalkc, NULL terminated)
+struct MicrobenchScenario {
+    const char *name;
+    const char *argv[MICROBENCH_ARGS_MAX];
+};
+
+static void microbench_contains(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += dictionary_contains(fx->dict, fx->words[i % MICROBENCH_WORDS], WT_ANY);
+    }
+}
+
+static void microbench_word(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *dictionary_word(&fx->view[WT_NOUN], &fx->rng);
+    }
+}
+
+static void microbench_talkf(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        strbuf_clear(&fx->out);
+        talkf_r(&fx->ctx, DEFAULT_FORMAT, &fx->out, NULL, 0);
+        fx->sink += fx->out.len;
+    }
+}
+
+static void microbench_acronym(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        strbuf_clear(&fx->out);
+        talk_acronym_r(&fx->ctx, &fx->acronym, "jdtalk", &fx->out, NULL, 0);
+        fx->sink += fx->out.len;
+    }
+}
+
+/**
+ * Copy the phrase of a fixture into its scratch space
+ * @param fx pointer to fixture
+ * @return scratch space
+ */
+static char *microbench_scratch(struct MicrobenchFixture *fx) {
+    strcpy(fx->scratch, fx->phrase);
+    return fx->scratch;
+}
+
+static void microbench_random_case(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *str_random_case(microbench_scratch(fx), &fx->rng);
+    }
+}
+
+static void microbench_hill_case(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *str_hill_case(microbench_scratch(fx));
+    }
+}
+
+static void microbench_title_case(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *str_title_case(microbench_scratch(fx));
+    }
+}
+
+static void microbench_leet(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *str_leet(microbench_scratch(fx));
+    }
+}
+
+static void microbench_shuffle(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *str_randomize_words(microbench_scratch(fx), &fx->rng);
+    }
+}
+
+static void microbench_reverse(struct MicrobenchFixture *fx, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fx->sink += (size_t) *str_reverse(microbench_scratch(fx));
+    }
+}
+
+static void microbench_transform(struct MicrobenchFixture *fx, size_t n) {
+    size_t len = strlen(fx->phrase);
+    for (size_t i = 0; i < n; i++) {
+        strbuf_clear(&fx->out);
+        str_transform_r(fx->phrase, len, STR_RANDOM_CASE | STR_LEET | STR_REVERSE, &fx->rng, &fx->out);
+        fx->sink += fx->out.len;
+    }
+}
+
+static const struct Microbench microbenches[] = {
+    {"dictionary_contains", microbench_contains},
+    {"dictionary_word", microbench_word},
+    {"talkf", microbench_talkf},
+    {"talk_acronym", microbench_acronym},
+    {"str_random_case", microbench_random_case},
+    {"str_hill_case", microbench_hill_case},
+    {"str_title_case", microbench_title_case},
+    {"str_leet", microbench_leet},
+    {"str_randomize_words", microbench_shuffle},
+    {"str_reverse", microbench_reverse},
+    {"str_transform_r", microbench_transform},
+};
+#define MICROBENCHES (sizeof(microbenches) / sizeof(*microbenches))
+
+// One scenario per generator mode and output path of jdtalkc
+static const struct MicrobenchScenario scenarios[] = {
+    {"cli_format", {NULL}},
+    {"cli_format_custom", {"-f", "a2n{and}v", NULL}},
+    {"cli_salad", {"-s", "5", NULL}},
+    {"cli_heart", {"-x", NULL}},
+    {"cli_acronym", {"-a", "jdtalk", NULL}},
+    {"cli_pattern", {"-p", "ing", NULL}},
+    {"cli_pattern_exact", {"-e", "-p", "dog", NULL}},
+    {"cli_case", {"-r", "-t", NULL}},
+    {"cli_hill_case", {"-H", NULL}},
+    {"cli_leet_shuffle_reverse", {"-l", "-S", "-R", NULL}},
+    {"cli_threads", {"-T", "4", NULL}},
+    {"cli_json", {"-j", NULL}},
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(*scenarios))
+
+/**
+ * Print a usage statement
+ * @param name program name
+ * @param fp stream receiving the usage statement
+ */
+static void usage(const char *name, FILE *fp) {
+    fprintf(fp, "usage: %s [-h] [-o file] [-b baseline] [-t percent] [-m ms] [-f filter]\n"
+                "  -b file   Compare the results with a baseline written by -o\n"
+                "  -f str    Only run benchmarks whose name contains `str`\n"
+                "  -h        Show this usage statement\n"
+                "  -m ms     Length of each sample (default: %d)\n"
+                "  -o file   Write the results as JSON to `file` (default: standard output)\n"
+                "  -t pct    Slowdown reported as a regression (default: %.0f%%)\n"
+                "\n"
+                "Exits with 1 when a benchmark regressed against the baseline.\n",
+            name, MICROBENCH_SAMPLE_MS, MICROBENCH_THRESHOLD);
+}
+
+/**
+ * Compare samples
+ * @param a pointer to sample
+ * @param b pointer to sample
+ * @return <0, 0, >0 (ascending order)
+ */
+static int microbench_cmp(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Measure a microbenchmark
+ *
+ * After a warmup, the number of operations filling a sample is estimated,
+ * and every sample reseeds the random number generator, so each sample
+ * repeats the same work. The median sample is reported.
+ *
+ * @param mb pointer to microbenchmark
+ * @param fx pointer to fixture
+ * @param sample_ns length of each sample in nanoseconds
+ * @param result pointer to result
+ */
+static void microbench_measure(const struct Microbench *mb, struct MicrobenchFixture *fx, uint64_t sample_ns, struct MicrobenchResult *result) {
+    double samples[MICROBENCH_SAMPLES];
+    uint64_t start;
+    uint64_t elapsed;
+    size_t n;
+
+    rng_seed(&fx->rng, MICROBENCH_SEED);
+    n = 1;
+    start = bench_now();
+    do {
+        uint64_t t = bench_now();
+        mb->run(fx, n);
+        elapsed = bench_now() - t;
+        if (elapsed < sample_ns / 8) {
+            n *= 2;
+        }
+    } while (bench_now() - start < MICROBENCH_WARMUP_NS || elapsed < sample_ns / 8);
+    n = (size_t) ((double) n * (double) sample_ns / (double) (elapsed ? elapsed : 1));
+    if (!n) {
+        n = 1;
+    }
+
+    for (size_t i = 0; i < MICROBENCH_SAMPLES; i++) {
+        rng_seed(&fx->rng, MICROBENCH_SEED);
+        start = bench_now();
+        mb->run(fx, n);
+        samples[i] = (double) (bench_now() - start) / (double) n;
+    }
+    qsort(samples, MICROBENCH_SAMPLES, sizeof(*samples), microbench_cmp);
+    snprintf(result->name, sizeof(result->name), "%s", mb->name);
+    result->ns_per_op = samples[MICROBENCH_SAMPLES / 2];
+    result->iterations = n;
+}
+
+/**
+ * Measure an end-to-end scenario
+ *
+ * The request runs in process, exactly as jdtalkc would run it, with a
+ * fixed seed and its output written to /dev/null. An operation is one
+ * line of output.
+ *
+ * @param sc pointer to scenario
+ * @param dict pointer to dictionary
+ * @param view array of dictionary views (indexed by word type)
+ * @param result pointer to result
+ * @return 0=success, -1=the scenario is invalid
+ */
+static int microbench_scenario(const struct MicrobenchScenario *sc, const struct Dictionary *dict, const struct DictionaryView *view, struct MicrobenchResult *result) {
+    double samples[MICROBENCH_SAMPLES];
+    char *argv[MICROBENCH_ARGS_MAX + 6];
+    char limit[32];
+    char seed[32];
+    int argc;
+    int fd;
+
+    snprintf(limit, sizeof(limit), "%d", MICROBENCH_LINES);
+    snprintf(seed, sizeof(seed), "%lu", MICROBENCH_SEED);
+    argc = 0;
+    argv[argc++] = "jdtalkc";
+    argv[argc++] = "-c";
+    argv[argc++] = limit;
+    argv[argc++] = "--seed";
+    argv[argc++] = seed;
+    for (size_t i = 0; sc->argv[i]; i++) {
+        argv[argc++] = (char *) sc->argv[i];
+    }
+    argv[argc] = NULL;
+
+    fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        perror("Unable to open /dev/null");
+        exit(1);
+    }
+    // The first run warms up the caches and is not counted
+    for (size_t i = 0; i <= MICROBENCH_SAMPLES; i++) {
+        struct StrBuf errbuf;
+        struct Request req;
+        struct Output out;
+        uint64_t start;
+        int rc;
+
+        strbuf_new(&errbuf, 0);
+        request_init(&req);
+        rc = request_parse(&req, argc, argv, &errbuf);
+        if (rc == 0) {
+            rc = request_prepare(&req, dict, view, &errbuf);
+        }
+        if (rc < 0) {
+            fprintf(stderr, "Invalid scenario %s: %s\n", sc->name, errbuf.data);
+            request_free(&req);
+            strbuf_free(&errbuf);
+            close(fd);
+            return -1;
+        }
+        output_init(&out, fd, OUTPUT_BULK);
+        start = bench_now();
+        request_run(&req, view, NULL, &out, &errbuf);
+        output_close(&out);
+        if (i) {
+            samples[i - 1] = (double) (bench_now() - start) / MICROBENCH_LINES;
+        }
+        request_free(&req);
+        strbuf_free(&errbuf);
+    }
+    close(fd);
+
+    qsort(samples, MICROBENCH_SAMPLES, sizeof(*samples), microbench_cmp);
+    snprintf(result->name, sizeof(result->name), "%s", sc->name);
+    result->ns_per_op = samples[MICROBENCH_SAMPLES / 2];
+    result->iterations = MICROBENCH_LINES;
+    return 0;
+}
+
+/**
+ * Write results as JSON
+ *
+ * Each result is written on a line of its own, which is what
+ * microbench_baseline expects to read back.
+ *
+ * @param fp stream receiving the results
+ * @param results array of results
+ * @param nresults number of results
+ */
+static void microbench_write(FILE *fp, const struct MicrobenchResult *results, size_t nresults) {
+    fprintf(fp, "{\n  \"seed\": %lu,\n  \"samples\": %d,\n  \"benchmarks\": [\n", MICROBENCH_SEED, MICROBENCH_SAMPLES);
+    for (size_t i = 0; i < nresults; i++) {
+        const struct MicrobenchResult *r = &results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.3f, \"ops_per_second\": %.1f}%s\n",
+                r->name, r->iterations, r->ns_per_op, r->ns_per_op > 0 ? 1e9 / r->ns_per_op : 0, i + 1 < nresults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+/**
+ * Find the time per operation of a benchmark in a baseline
+ * @param baseline contents of a file written by microbench_write
+ * @param name name of benchmark
+ * @return nanoseconds per operation, or -1 if the baseline doesn't have the benchmark
+ */
+static double microbench_baseline(const char *baseline, const char *name) {
+    char key[128];
+    const char *s;
+
+    if ((size_t) snprintf(key, sizeof(key), "\"name\": \"%s\"", name) >= sizeof(key)) {
+        return -1;
+    }
+    s = strstr(baseline, key);
+    if (!s) {
+        return -1;
+    }
+    s = strstr(s, "\"ns_per_op\": ");
+    if (!s) {
+        return -1;
+    }
+    return strtod(s + strlen("\"ns_per_op\": "), NULL);
+}
+
+/**
+ * Read a whole file
+ * @param path path to file
+ * @return NUL terminated contents (free it), or NULL on failure (errno is set)
+ */
+static char *microbench_slurp(const char *path) {
+    struct StrBuf sb;
+    char buf[BUFSIZ];
+    size_t n;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        return NULL;
+    }
+    strbuf_new(&sb, 0);
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        strbuf_append(&sb, buf, n);
+    }
+    fclose(fp);
+    return sb.data;
+}
+
+/**
+ * Report the change of each benchmark against a baseline
+ * @param baseline contents of a file written by microbench_write
+ * @param results array of results
+ * @param nresults number of results
+ * @param threshold slowdown reported as a regression (percent)
+ * @return number of regressions
+ */
+static size_t microbench_compare(const char *baseline, const struct MicrobenchResult *results, size_t nresults, double threshold) {
+    size_t regressions = 0;
+
+    fprintf(stderr, "%-28s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+    for (size_t i = 0; i < nresults; i++) {
+        const struct MicrobenchResult *r = &results[i];
+        double base = microbench_baseline(baseline, r->name);
+        double change;
+
+        if (base <= 0) {
+            fprintf(stderr, "%-28s %14s %14.3f %9s\n", r->name, "-", r->ns_per_op, "new");
+            continue;
+        }
+        change = (r->ns_per_op - base) * 100.0 / base;
+        fprintf(stderr, "%-28s %14.3f %14.3f %+8.1f%%%s\n", r->name, base, r->ns_per_op, change, change > threshold ? " REGRESSION" : "");
+        if (change > threshold) {
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    struct MicrobenchResult results[MICROBENCHES + SCENARIOS];
+    struct MicrobenchFixture fx;
+    struct Dictionary *dict;
+    struct Rng rng;
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    const char *filter = "";
+    double threshold = MICROBENCH_THRESHOLD;
+    uint64_t sample_ns = MICROBENCH_SAMPLE_MS * 1000000ULL;
+    size_t nresults;
+    size_t regressions;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:f:hm:o:t:")) != -1) {
+        switch (opt) {
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'h':
+                usage(argv[0], stdout);
+                return 0;
+            case 'm':
+                sample_ns = strtoull(optarg, NULL, 10) * 1000000ULL;
+                if (!sample_ns) {
+                    fprintf(stderr, "-m requires a positive number of milliseconds\n");
+                    exit(1);
+                }
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            case 't':
+                threshold = strtod(optarg, NULL);
+                break;
+            default:
+                usage(argv[0], stderr);
+                exit(1);
+        }
+    }
+
+    dict = dictionary_populate(DICT_TYPES_ALL);
+    struct DictionaryView view[WT_VERB + 1] = {
+        dictionary_view(dict, WT_ANY),
+        dictionary_view(dict, WT_NOUN),
+        dictionary_view(dict, WT_ADJECTIVE),
+        dictionary_view(dict, WT_ADVERB),
+        dictionary_view(dict, WT_VERB),
+    };
+
+    memset(&fx, 0, sizeof(fx));
+    fx.dict = dict;
+    fx.view = view;
+    talk_init(&fx.ctx, view, &fx.rng);
+    strbuf_new(&fx.out, 0);
+    if (format_compile(&fx.acronym, "xxxx", view) < 0) {
+        fprintf(stderr, "Unable to compile acronym format\n");
+        exit(1);
+    }
+    // Lookups hit three times out of four
+    rng_seed(&rng, MICROBENCH_SEED);
+    for (size_t i = 0; i < MICROBENCH_WORDS; i++) {
+        const char *word = dictionary_word(&view[WT_ANY], &rng);
+        if (i % 4 == 3) {
+            snprintf(fx.misses[i / 4], sizeof(fx.misses[i / 4]), "%sqx", word);
+            word = fx.misses[i / 4];
+        }
+        fx.words[i] = word;
+    }
+    fx.phrase = "the quick brown fox jumps over the lazy dog";
+
+    nresults = 0;
+    for (size_t i = 0; i < MICROBENCHES; i++) {
+        if (!strstr(microbenches[i].name, filter)) {
+            continue;
+        }
+        microbench_measure(&microbenches[i], &fx, sample_ns, &results[nresults]);
+        fprintf(stderr, "%-28s %12.3f ns/op\n", results[nresults].name, results[nresults].ns_per_op);
+        nresults++;
+    }
+    for (size_t i = 0; i < SCENARIOS; i++) {
+        if (!strstr(scenarios[i].name, filter)) {
+            continue;
+        }
+        if (microbench_scenario(&scenarios[i], dict, view, &results[nresults]) < 0) {
+            exit(1);
+        }
+        fprintf(stderr, "%-28s %12.3f ns/line\n", results[nresults].name, results[nresults].ns_per_op);
+        nresults++;
+    }
+
+    if (output_path) {
+        FILE *fp = fopen(output_path, "w");
+        if (!fp) {
+            fprintf(stderr, "Unable to write results: %s: %s\n", output_path, strerror(errno));
+            exit(1);
+        }
+        microbench_write(fp, results, nresults);
+        if (fclose(fp) != 0) {
+            fprintf(stderr, "Unable to write results: %s: %s\n", output_path, strerror(errno));
+            exit(1);
+        }
+    } else {
+        microbench_write(stdout, results, nresults);
+    }
+
+    regressions = 0;
+    if (baseline_path) {
+        char *baseline = microbench_slurp(baseline_path);
+        if (!baseline) {
+            fprintf(stderr, "Unable to read baseline: %s: %s\n", baseline_path, strerror(errno));
+            exit(1);
+        }
+        regressions = microbench_compare(baseline, results, nresults, threshold);
+        free(baseline);
+    }
+
+    format_free(&fx.acronym);
+    strbuf_free(&fx.out);
+    dictionary_free(dict);
+    return regressions ? 1 : 0;
+}
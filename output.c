@@ -0,0 +1,209 @@
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "jdtalk.h"
+
+/**
+ * Write bytes to a file descriptor, retrying short writes
+ *
+ * @param fd file descriptor
+ * @param iov array of buffers (modified)
+ * @param iovcnt number of buffers
+ * @return 0=success, -1=failure (errno is set)
+ */
+static int output_writev_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (iovcnt && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= (size_t) written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Initialize an output stream
+ *
+ * OUTPUT_AUTO selects OUTPUT_LINE when fd is a terminal and OUTPUT_BULK
+ * otherwise.
+ *
+ * @param out pointer to output stream
+ * @param fd file descriptor to write to
+ * @param mode OUTPUT_LINE, OUTPUT_BULK or OUTPUT_AUTO
+ */
+void output_init(struct Output *out, int fd, int mode) {
+    if (mode == OUTPUT_AUTO) {
+        mode = isatty(fd) ? OUTPUT_LINE : OUTPUT_BULK;
+    }
+    out->fd = fd;
+    out->mode = mode;
+    out->len = 0;
+    out->size = OUTPUT_BUFFER_SIZE;
+    out->error = 0;
+    out->buf = malloc(out->size);
+    if (!out->buf) {
+        perror("Unable to allocate output buffer");
+        exit(1);
+    }
+}
+
+/**
+ * Write buffered bytes to the file descriptor
+ * @param out pointer to output stream
+ * @return 0=success, -1=failure (out->error is set)
+ */
+int output_flush(struct Output *out) {
+    struct iovec iov;
+
+    if (!out->len) {
+        return out->error ? -1 : 0;
+    }
+    iov.iov_base = out->buf;
+    iov.iov_len = out->len;
+    out->len = 0;
+    if (!out->error && output_writev_all(out->fd, &iov, 1) < 0) {
+        out->error = errno;
+    }
+    return out->error ? -1 : 0;
+}
+
+/**
+ * Append bytes to an output stream
+ *
+ * Bytes are collected until the buffer fills. Writes larger than the
+ * buffer are passed to the kernel together with the buffered bytes in
+ * a single writev call.
+ *
+ * @param out pointer to output stream
+ * @param s bytes to write
+ * @param n number of bytes to write
+ * @return 0=success, -1=failure (out->error is set)
+ */
+int output_write(struct Output *out, const char *s, size_t n) {
+    if (out->error) {
+        return -1;
+    }
+    if (out->len + n > out->size) {
+        if (n >= out->size) {
+            struct iovec iov[2];
+            iov[0].iov_base = out->buf;
+            iov[0].iov_len = out->len;
+            iov[1].iov_base = (void *) s;
+            iov[1].iov_len = n;
+            out->len = 0;
+            if (output_writev_all(out->fd, iov, 2) < 0) {
+                out->error = errno;
+                return -1;
+            }
+            return 0;
+        }
+        if (output_flush(out) < 0) {
+            return -1;
+        }
+    }
+    memcpy(out->buf + out->len, s, n);
+    out->len += n;
+    if (out->mode == OUTPUT_LINE && memchr(s, '\n', n)) {
+        return output_flush(out);
+    }
+    return 0;
+}
+
+/**
+ * Append a string to an output stream
+ * @param out pointer to output stream
+ * @param s string to write
+ * @return 0=success, -1=failure
+ */
+int output_puts(struct Output *out, const char *s) {
+    return output_write(out, s, strlen(s));
+}
+
+/**
+ * Append a line to an output stream
+ * @param out pointer to output stream
+ * @param s line to write (without newline)
+ * @param n length of line
+ * @return 0=success, -1=failure
+ */
+int output_line(struct Output *out, const char *s, size_t n) {
+    if (out->len + n + 1 <= out->size) {
+        // Fast path: the line and its newline fit in the buffer
+        memcpy(out->buf + out->len, s, n);
+        out->len += n;
+        out->buf[out->len++] = '\n';
+        if (out->mode == OUTPUT_LINE) {
+            return output_flush(out);
+        }
+        return out->error ? -1 : 0;
+    }
+    if (output_write(out, s, n) < 0) {
+        return -1;
+    }
+    return output_write(out, "\n", 1);
+}
+
+/**
+ * Append formatted text to an output stream
+ * @param out pointer to output stream
+ * @param fmt printf format
+ * @return 0=success, -1=failure
+ */
+int output_printf(struct Output *out, const char *fmt, ...) {
+    char buf[OUTPUT_SIZE_MAX];
+    char *text;
+    va_list ap;
+    int len;
+    int result;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len < 0) {
+        return -1;
+    }
+    if ((size_t) len < sizeof(buf)) {
+        return output_write(out, buf, (size_t) len);
+    }
+
+    text = malloc((size_t) len + 1);
+    if (!text) {
+        perror("Unable to allocate output text");
+        exit(1);
+    }
+    va_start(ap, fmt);
+    vsnprintf(text, (size_t) len + 1, fmt, ap);
+    va_end(ap);
+    result = output_write(out, text, (size_t) len);
+    free(text);
+    return result;
+}
+
+/**
+ * Flush and release an output stream
+ *
+ * The file descriptor is left open.
+ *
+ * @param out pointer to output stream
+ * @return 0=success, -1=a write failed (out->error is set)
+ */
+int output_close(struct Output *out) {
+    int result;
+    result = output_flush(out);
+    free(out->buf);
+    out->buf = NULL;
+    out->size = 0;
+    return result;
+}
@@ -0,0 +1,741 @@
+#include "jdtalk.h"
+
+static const char *usage_text = \
+        "usage: %s [-h] [-befHlrtx] [-s salad_word_count] [-c line_limit] [-p pattern] [-a acronym]\n"
+        "       %s --serve path [--workers num] [--cache-depth num]\n"
+        "       %s --connect path [options]\n"
+        "  -a str    Acronym mode\n"
+        "  -b        Report the time of each phase, throughput, retries and latency (JSON with -j)\n"
+        "  -c num    Output `num` lines\n"
+        "  -j        Enable JSON output (requires -c)\n"
+        "  -e        Exact match (use with -p)\n"
+        "  -f str    Custom output format\n"
+        "            (a=adjective, d=adverb, n=noun, v=verb, x=any)\n"
+        "            (a number repeats the previous token, {text} is literal text)\n"
+        "  -h        Show this usage statement\n"
+        "  -H        Produce hill-cased strings (hIlL cAsE)\n"
+        "  -l        Produce leet speak strings (1337 5|*34|<)\n"
+        "  -p str    Search for `str` in output\n"
+        "  -r        Produce random-case strings (raNdoM CasE)\n"
+        "  -R        Produce reversed strings (sgnirts desrever)\n"
+        "  -s num    Produce word salad (`num` words per line)\n"
+        "  -S        Produce shuffled strings (fsfhleudf sntsrgi)\n"
+        "  -t        Produce title-case strings (Title Case)\n"
+        "  -T num    Generate with `num` worker threads\n"
+        "  -U        Emit lines as workers finish them (use with -T)\n"
+        "  -x        Produce heart candy phrases\n"
+        "  --heart-limit num\n"
+        "            Number of words per heart candy phrase (default: 3)\n"
+        "  --heart-maxlen num\n"
+        "            Maximum length of heart candy words (default: 5)\n"
+        "  --ndjson  Write each line as a JSON object on a line of its own (works without -c)\n"
+        "  --parts   Include the words of each line and their types (use with -j or --ndjson)\n"
+        "  --seed num\n"
+        "            Seed the random number generator (reproducible output)\n"
+        "  --compile-dict\n"
+        "            Compile $JDTALK_DATA into a binary image (" DICT_IMAGE_NAME ") and exit\n"
+        "  --shared-dict\n"
+        "            Share the loaded dictionary with other processes through shared memory\n"
+        "            (kept in /dev/shm/jdtalk-*, remove it to make the next process publish it again)\n"
+        "  --serve path\n"
+        "            Load the dictionary once and answer requests on a Unix socket\n"
+        "  --workers num\n"
+        "            Number of requests answered at once (use with --serve, default: one per processor)\n"
+        "            Requests may not use more generator threads (-T) than this\n"
+        "  --cache-depth num\n"
+        "            Phrases kept ready per request shape (use with --serve, default: 1024, 0=no cache)\n"
+        "  --cache-low num\n"
+        "  --cache-high num\n"
+        "            Refill a phrase cache below `low` phrases up to `high` phrases\n"
+        "            (use with --serve, default: a quarter of the depth, the whole depth)\n"
+        "  --cache-stats\n"
+        "            Report the hits and misses of the phrase cache (use with --connect)\n"
+        "  --connect path\n"
+        "            Send the remaining options to a server and print its reply (must come first)\n"
+        "\n";
+
+/**
+ * Produce the usage statement
+ * @param name program name
+ * @param sb string builder receiving the usage statement
+ */
+void request_usage(const char *name, struct StrBuf *sb) {
+    const char *begin;
+
+    // Get the basename of name
+    begin = strrchr(name, '/');
+    begin = begin && begin[1] ? begin + 1 : name;
+    strbuf_printf(sb, usage_text, begin, begin, begin);
+}
+
+/**
+ * Validate s against possible arguments
+ * @param possible short options
+ * @param s input string to validate
+ * @return 0=invalid, 1=valid
+ */
+static int argv_validate(const char *possible, const char *s) {
+    if (strlen(s) > 1) {
+        // s is a short option (i.e. -c)
+        for (size_t i = 0; i < strlen(possible); i++) {
+            if (possible[i] == *(s + 1))
+                // s is a valid short option
+                return 1;
+        }
+    }
+    // s is an invalid short option
+    return 0;
+}
+
+/**
+ * Convert an option value to an integer
+ * @param value option value (NULL=missing)
+ * @param result receives the integer
+ * @param min smallest valid value
+ * @return 0=success, -1=invalid
+ */
+static int option_size(const char *value, size_t *result, size_t min) {
+    char *end;
+    unsigned long long n;
+
+    if (!value || !isdigit((unsigned char) *value)) {
+        return -1;
+    }
+    errno = 0;
+    n = strtoull(value, &end, 10);
+    if (errno || *end != '\0' || n < min || n > SIZE_MAX) {
+        return -1;
+    }
+    *result = (size_t) n;
+    return 0;
+}
+
+/**
+ * Find a word of a search pattern that no dictionary word contains
+ * @param dict pointer to indexed dictionary
+ * @param pattern search pattern (words separated by spaces)
+ * @param word buffer receiving the missing word (INPUT_SIZE_MAX bytes)
+ * @return word, or NULL if every word is contained
+ */
+static const char *pattern_missing(const struct Dictionary *dict, const char *pattern, char *word) {
+    while (*pattern) {
+        size_t len = strcspn(pattern, " ");
+        if (len && len < INPUT_SIZE_MAX) {
+            uint32_t *match;
+            size_t count;
+
+            memcpy(word, pattern, len);
+            word[len] = '\0';
+            match = index_substring(dict, word, &count);
+            if (!match) {
+                return word;
+            }
+            free(match);
+        }
+        pattern += len + (pattern[len] == ' ');
+    }
+    return NULL;
+}
+
+/**
+ * Get the word types a request draws from or validates against
+ *
+ * Salad and heart phrases draw from words of any type, and checking a
+ * search pattern looks words up across every type.
+ *
+ * @param req pointer to parsed request
+ * @return bitmask of word types (1 << WT_*)
+ */
+unsigned request_types(const struct Request *req) {
+    const struct Options *opt = &req->opt;
+
+    if (opt->do_salad || opt->do_heart || opt->do_pattern) {
+        return DICT_TYPES_ALL;
+    }
+    if (opt->do_acronym && strcmp(opt->format, DEFAULT_FORMAT) == 0) {
+        // Replaced by "xxxx" (see request_prepare)
+        return DICT_TYPES_ALL;
+    }
+    return format_types(opt->format);
+}
+
+/**
+ * Initialize a request with the default options
+ * @param req pointer to request (release with request_free)
+ */
+void request_init(struct Request *req) {
+    struct Options *opt = &req->opt;
+
+    memset(req, 0, sizeof(*req));
+    opt->salad_limit = 10;
+    opt->heart_limit = 3;
+    opt->heart_maxlen = 5;
+    opt->format = DEFAULT_FORMAT;
+    opt->pattern = "";
+    opt->acronym = "";
+    opt->seed = rng_seed_default();
+    opt->cache_depth = CACHE_DEPTH_DEFAULT;
+}
+
+#define ARG(X) strcmp(option, X) == 0
+static const char *args_valid = "AabcefhHjlprRsStTUx";
+
+/**
+ * Read options from a command line
+ *
+ * Option values point into argv, so argv must outlive the request. An
+ * unknown option also sets opt.do_usage.
+ *
+ * @param req pointer to request
+ * @param argc number of arguments (including the program name)
+ * @param argv arguments (NULL terminated)
+ * @param errbuf string builder receiving the error message
+ * @return 0=success, -1=invalid command line
+ */
+int request_parse(struct Request *req, int argc, char *argv[], struct StrBuf *errbuf) {
+    struct Options *opt = &req->opt;
+
+    for (int i = 1; i < argc; i++) {
+        char *option;
+        char *option_value;
+        option = argv[i];
+        option_value = argv[i + 1];
+
+        if (ARG("--compile-dict")) {
+            opt->do_compile = 1;
+            continue;
+        }
+        if (ARG("--shared-dict")) {
+            opt->do_shared_dict = 1;
+            continue;
+        }
+        if (ARG("--ndjson")) {
+            opt->do_ndjson = 1;
+            continue;
+        }
+        if (ARG("--parts")) {
+            opt->do_parts = 1;
+            continue;
+        }
+        if (ARG("--seed")) {
+            char *end;
+            if (!option_value || !isdigit((unsigned char) *option_value)) {
+                strbuf_printf(errbuf, "requires a positive integer option_value");
+                return -1;
+            }
+            errno = 0;
+            opt->seed = (uint64_t) strtoull(option_value, &end, 10);
+            if (errno || *end != '\0') {
+                strbuf_printf(errbuf, "invalid seed: %s", option_value);
+                return -1;
+            }
+            opt->do_seed = 1;
+            i++;
+            continue;
+        }
+        if (ARG("--heart-limit") || ARG("--heart-maxlen") || ARG("--workers") || ARG("--cache-low") || ARG("--cache-high")) {
+            size_t *dest = ARG("--heart-limit") ? &opt->heart_limit
+                           : ARG("--heart-maxlen") ? &opt->heart_maxlen
+                           : ARG("--workers") ? &opt->workers
+                           : ARG("--cache-low") ? &opt->cache_low : &opt->cache_high;
+            if (option_size(option_value, dest, 1) < 0) {
+                strbuf_printf(errbuf, "%s requires a positive integer option_value", option);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (ARG("--cache-depth")) {
+            if (option_size(option_value, &opt->cache_depth, 0) < 0) {
+                strbuf_printf(errbuf, "%s requires an integer option_value", option);
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (ARG("--cache-stats")) {
+            opt->do_cache_stats = 1;
+            continue;
+        }
+        if (ARG("--serve")) {
+            if (!option_value) {
+                strbuf_printf(errbuf, "%s requires a socket path", option);
+                return -1;
+            }
+            opt->serve = option_value;
+            i++;
+            continue;
+        }
+        if (!argv_validate(args_valid, option)) {
+            strbuf_printf(errbuf, "Unknown argument: %s", option);
+            opt->do_usage = 1;
+            return -1;
+        }
+        if (ARG("-h")) {
+            opt->do_usage = 1;
+            return 0;
+        }
+        if (ARG("-b")) {
+            opt->do_benchmark = 1;
+        }
+        if (ARG("-j")) {
+            opt->do_json = 1;
+        }
+        if (ARG("-c")) {
+            if (!option_value || *option_value == '-') {
+                strbuf_printf(errbuf, "requires a positive integer option_value");
+                return -1;
+            }
+
+            opt->limit = (int) strtol(option_value, NULL, 10);
+            if (!opt->limit) {
+                opt->limit = 1;
+            }
+            i++;
+            continue;
+        }
+        if (ARG("-p")) {
+            if (!option_value || *option_value == '-') {
+                strbuf_printf(errbuf, "requires a dictionary word");
+                return -1;
+            }
+            opt->do_pattern = 1;
+            opt->pattern = option_value;
+            i++;
+            continue;
+        }
+        if (ARG("-e")) {
+            opt->do_exact = 1;
+        }
+        if (ARG("-r")) {
+            opt->do_random_case = 1;
+        }
+        if (ARG("-H")) {
+            opt->do_hill_case = 1;
+        }
+        if (ARG("-l")) {
+            opt->do_leet = 1;
+        }
+        if (ARG("-s")) {
+            if (!option_value || *option_value == '-') {
+                strbuf_printf(errbuf, "requires a positive integer option_value");
+                return -1;
+            }
+
+            opt->do_salad = 1;
+            opt->salad_limit = (int) strtol(option_value, NULL, 10);
+            if (!opt->salad_limit) {
+                opt->salad_limit = 1;
+            }
+            i++;
+            continue;
+        }
+        if (ARG("-x")) {
+            opt->do_heart = 1;
+        }
+        if (ARG("-f")) {
+            if (!option_value) {
+                strbuf_printf(errbuf, "requires a format");
+                return -1;
+            }
+            opt->do_format = 1;
+            opt->format = option_value;
+            i++;
+            continue;
+        }
+        if (ARG("-a")) {
+            if (!option_value) {
+                strbuf_printf(errbuf, "requires a string");
+                return -1;
+            }
+            opt->do_acronym = 1;
+            opt->do_title_case = 1;
+            opt->acronym = option_value;
+            i++;
+            continue;
+        }
+        if (ARG("-t")) {
+            opt->do_title_case = 1;
+        }
+        if (ARG("-S")) {
+            opt->do_shuffle = 1;
+        }
+        if (ARG("-R")) {
+            opt->do_reverse = 1;
+        }
+        if (ARG("-T")) {
+            if (option_size(option_value, &opt->threads, 0) < 0) {
+                strbuf_printf(errbuf, "requires a positive integer option_value");
+                return -1;
+            }
+            if (!opt->threads) {
+                opt->threads = 1;
+            }
+            i++;
+            continue;
+        }
+        if (ARG("-U")) {
+            opt->do_unordered = 1;
+        }
+    }
+
+    if (opt->do_json && opt->do_ndjson) {
+        strbuf_printf(errbuf, "-j and --ndjson can't be used together");
+        return -1;
+    }
+    if (opt->do_parts && !opt->do_json && !opt->do_ndjson) {
+        strbuf_printf(errbuf, "--parts requires -j or --ndjson");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Determine whether a request produces JSON
+ *
+ * -j only applies to a limited number of lines, since the document must
+ * be closed. NDJSON objects stand alone, so --ndjson always applies.
+ *
+ * @param req pointer to request
+ * @return 0=plain text, 1=JSON
+ */
+int request_json(const struct Request *req) {
+    return req->opt.do_ndjson || (req->opt.do_json && req->opt.limit);
+}
+
+/**
+ * Check the options of a request against the dictionary and prepare to generate
+ *
+ * @param req pointer to request
+ * @param dict pointer to indexed dictionary
+ * @param view array of dictionary views (indexed by word type)
+ * @param errbuf string builder receiving the error message
+ * @return 0=success, -1=the request can't be answered
+ */
+int request_prepare(struct Request *req, const struct Dictionary *dict, const struct DictionaryView *view, struct StrBuf *errbuf) {
+    struct Options *opt = &req->opt;
+
+    if (opt->do_acronym && strcmp(opt->format, DEFAULT_FORMAT) == 0) {
+        opt->format = "xxxx";
+    }
+
+    if (format_compile(&req->format, opt->format, view) < 0) {
+        strbuf_printf(errbuf, "Invalid format: %s", opt->format);
+        return -1;
+    }
+    req->compiled = 1;
+    opt->plan = &req->format;
+
+    // Literal text of the format may satisfy the pattern too
+    if (opt->do_pattern && opt->do_exact && !dictionary_contains(dict, opt->pattern, WT_ANY) && !format_has_literal(opt->plan)) {
+        strbuf_printf(errbuf, "Word not found in dictionary: %s", opt->pattern);
+        return -1;
+    }
+
+    if (opt->do_acronym && format_has_literal(opt->plan)) {
+        strbuf_printf(errbuf, "Literal text can't be used in acronym mode (format: %s)", opt->format);
+        return -1;
+    }
+
+    if ((opt->do_pattern && opt->do_exact && opt->do_acronym) && !acronym_safe(dict, opt->acronym, opt->pattern, opt->do_format ? NULL: opt->format)) {
+        strbuf_printf(errbuf, "Word will never appear in acronym, '%s': %s (format: %s)", opt->acronym, opt->pattern, opt->format);
+        return -1;
+    }
+
+    if (opt->do_salad && !view[WT_ANY].count) {
+        strbuf_printf(errbuf, "The dictionary holds no words");
+        return -1;
+    }
+
+    if (!opt->do_salad && !opt->do_heart && !opt->do_acronym && format_empty_view(opt->plan)) {
+        strbuf_printf(errbuf, "No words of type '%c' in dictionary (format: %s)", format_empty_view(opt->plan), opt->format);
+        return -1;
+    }
+
+    if ((opt->do_pattern && opt->do_heart) && strlen(opt->pattern) > opt->heart_maxlen) {
+        strbuf_printf(errbuf, "Word is too long for heart mode: %s (%zu > %zu)", opt->pattern, strlen(opt->pattern), opt->heart_maxlen);
+        return -1;
+    }
+
+    if (opt->do_heart && opt->heart_limit > 1 && !dictionary_count_short(&view[WT_ANY], opt->heart_maxlen)) {
+        strbuf_printf(errbuf, "No words are short enough for heart mode (%zu)", opt->heart_maxlen);
+        return -1;
+    }
+
+    if (opt->do_acronym) {
+        int pos = acronym_valid(opt->plan, opt->acronym);
+        if (pos >= 0) {
+            strbuf_printf(errbuf, "No word begins with '%c' in acronym, '%s' (format: %s)", opt->acronym[pos], opt->acronym, opt->format);
+            return -1;
+        }
+    }
+
+    if (opt->do_pattern && (opt->do_exact || !strchr(opt->pattern, ' '))) {
+        if (generate_plant(&req->plant, view, opt) < 0) {
+            strbuf_printf(errbuf, "%s will never appear in output: %s", opt->do_exact ? "Word" : "Pattern", opt->pattern);
+            return -1;
+        }
+        req->plant_ptr = &req->plant;
+    } else if (opt->do_pattern) {
+        // Patterns spanning words are matched against whole phrases, so each word of the pattern must exist
+        char word[INPUT_SIZE_MAX];
+        const char *missing = pattern_missing(dict, opt->pattern, word);
+        if (missing) {
+            strbuf_printf(errbuf, "Pattern will never appear in output: %s (no word contains: %s)", opt->pattern, missing);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Destination of generated lines
+struct Emitter {
+    const struct Options *opt;
+    const struct Dictionary *dict;  // types the words of each line
+    struct Output *out;
+    struct Json json;               // JSON output (see request_json)
+};
+
+/**
+ * Write one line of JSON output
+ *
+ * Pretty documents hold each line as a string, or as an object when parts
+ * are included. NDJSON lines are always objects.
+ *
+ * @param emitter pointer to emitter
+ * @param line line to write
+ * @param len length of line
+ * @param parts words of the line before transformation, NULL terminated (NULL=omit)
+ */
+static void emit_json(struct Emitter *emitter, const char *line, size_t len, const char *const *parts) {
+    struct Json *json = &emitter->json;
+
+    if (!emitter->opt->do_ndjson && !parts) {
+        json_string(json, line, len);
+        return;
+    }
+    json_object_begin(json);
+    json_key(json, "line");
+    json_string(json, line, len);
+    if (parts) {
+        json_key(json, "parts");
+        json_array_begin(json);
+        for (; *parts; parts++) {
+            int type = dictionary_word_type(emitter->dict, *parts);
+
+            json_object_begin(json);
+            json_key(json, "word");
+            json_string(json, *parts, strlen(*parts));
+            json_key(json, "type");
+            if (type < 0) {
+                json_null(json);
+            } else {
+                char format = dictionary_type_format((unsigned) type);
+                json_string(json, &format, 1);
+            }
+            json_object_end(json);
+        }
+        json_array_end(json);
+    }
+    json_object_end(json);
+}
+
+/**
+ * Write a block of lines produced by generate_chunk
+ * @param arg pointer to emitter
+ * @param lines newline terminated lines
+ * @param len length of lines in bytes
+ * @param parts words of each line, NULL after each line (NULL=not kept)
+ * @param nlines number of lines
+ * @return 0=success, -1=the output failed
+ */
+static int emit_lines(void *arg, const char *lines, size_t len, const char *const *parts, size_t nlines) {
+    struct Emitter *emitter = arg;
+
+    if (!emitter->json.out) {
+        return output_write(emitter->out, lines, len);
+    }
+
+    for (size_t i = 0; i < nlines; i++) {
+        const char *end = memchr(lines, '\n', len);
+        size_t line_len = (size_t) (end - lines);
+
+        emit_json(emitter, lines, line_len, parts);
+        if (parts) {
+            while (*parts++) {
+                continue;
+            }
+        }
+        len -= line_len + 1;
+        lines = end + 1;
+    }
+    return emitter->out->error ? -1 : 0;
+}
+
+/**
+ * Close the JSON output of a request
+ * @param req pointer to request
+ * @param json pointer to encoder (pretty documents are open at "data")
+ * @param error error message ("" for none)
+ */
+static void request_json_end(const struct Request *req, struct Json *json, const char *error) {
+    if (req->opt.do_ndjson) {
+        // Lines already stand alone, only an error needs an object
+        if (*error) {
+            json_object_begin(json);
+            json_key(json, "error");
+            json_string(json, error, strlen(error));
+            json_object_end(json);
+        }
+        return;
+    }
+    json_array_end(json);
+    json_key(json, "error");
+    json_string(json, error, strlen(error));
+    json_object_end(json);
+}
+
+/**
+ * Open the JSON output of a request
+ * @param req pointer to request
+ * @param json pointer to encoder
+ * @param out pointer to output stream
+ */
+static void request_json_begin(const struct Request *req, struct Json *json, struct Output *out) {
+    json_init(json, out, !req->opt.do_ndjson);
+    if (!req->opt.do_ndjson) {
+        json_object_begin(json);
+        json_key(json, "data");
+        json_array_begin(json);
+    }
+}
+
+/**
+ * Report a request that can't be answered
+ *
+ * JSON requests receive the error in the JSON output. Otherwise the
+ * message is written to err.
+ *
+ * @param req pointer to request
+ * @param out pointer to output stream
+ * @param err pointer to error stream
+ * @param error error message
+ */
+void request_error(const struct Request *req, struct Output *out, struct Output *err, const char *error) {
+    if (request_json(req)) {
+        struct Json json;
+
+        request_json_begin(req, &json, out);
+        request_json_end(req, &json, error);
+    } else {
+        output_printf(err, "%s\n", error);
+    }
+}
+
+/**
+ * Produce the output of a prepared request
+ *
+ * Generation stops early when the output fails. With a cache shape, lines
+ * come from its ring of ready phrases, and only lines the ring can't
+ * supply are generated on the spot.
+ *
+ * @param req pointer to request (see request_prepare)
+ * @param view array of dictionary views (indexed by word type)
+ * @param shape pointer to cache shape of the request (NULL=generate every line)
+ * @param out pointer to output stream
+ * @param errbuf string builder receiving the error message
+ * @return 0=success, -1=failure (JSON requests already carry the error)
+ */
+int request_run(const struct Request *req, const struct DictionaryView *view, struct CacheShape *shape, struct Output *out, struct StrBuf *errbuf) {
+    const struct Options *opt = &req->opt;
+    struct Bench *bench = req->bench;
+    struct Emitter emitter;
+    uint64_t start = 0;
+    int result = 0;
+
+    if (bench) {
+        start = bench_now();
+    }
+    emitter.opt = opt;
+    emitter.dict = view[WT_ANY].dict;
+    emitter.out = out;
+    memset(&emitter.json, 0, sizeof(emitter.json));
+    if (request_json(req)) {
+        request_json_begin(req, &emitter.json, out);
+    }
+
+    if (opt->threads && !shape) {
+        if (generate_parallel(view, opt, req->plant_ptr, emit_lines, &emitter, bench) < 0) {
+            strbuf_printf(errbuf, "Unable to start worker threads: %s", strerror(errno));
+            result = -1;
+        }
+    } else {
+        struct GenerateBatch batch;
+        struct Talk ctx;
+        struct Rng rng;
+
+        talk_init(&ctx, view, &rng);
+        ctx.plant = req->plant_ptr;
+        generate_batch_init(&batch, opt);
+        batch.bench = bench;
+        for (size_t i = 0; !opt->limit || i < opt->limit; ) {
+            size_t nlines = GENERATE_CHUNK_LINES;
+            uint64_t emitted = 0;
+
+            if (opt->limit && opt->limit - i < nlines) {
+                nlines = opt->limit - i;
+            }
+            // Chunks draw from the same streams as those of ordered workers (see generate_parallel)
+            rng_seed_stream(&rng, opt->seed, i / GENERATE_CHUNK_LINES);
+            if (shape) {
+                strbuf_clear(&batch.chunk);
+                for (size_t j = 0; j < nlines; j++) {
+                    if (cache_take(shape, &batch.chunk) < 0) {
+                        generate_line(&ctx, opt, &batch.line, &batch.phrase, batch.parts, batch.parts_max);
+                        strbuf_append(&batch.chunk, batch.line.data, batch.line.len);
+                    }
+                    strbuf_putc(&batch.chunk, '\n');
+                }
+            } else {
+                generate_chunk(&ctx, opt, &batch, nlines);
+            }
+            if (bench) {
+                emitted = bench_now();
+            }
+            if (emit_lines(&emitter, batch.chunk.data, batch.chunk.len, batch.line_parts, nlines) < 0) {
+                break;
+            }
+            if (bench) {
+                bench->phase[BENCH_OUTPUT] += bench_now() - emitted;
+            }
+            i += nlines;
+        }
+        if (bench) {
+            bench->redrawn += ctx.redrawn;
+        }
+        generate_batch_free(&batch);
+    }
+
+    if (request_json(req)) {
+        request_json_end(req, &emitter.json, result < 0 ? errbuf->data : "");
+    }
+    if (bench) {
+        bench->run += bench_now() - start;
+    }
+    return result;
+}
+
+/**
+ * Release a request
+ * @param req pointer to request
+ */
+void request_free(struct Request *req) {
+    if (req->plant_ptr) {
+        generate_plant_free(&req->plant);
+        req->plant_ptr = NULL;
+    }
+    if (req->compiled) {
+        format_free(&req->format);
+        req->compiled = 0;
+    }
+}
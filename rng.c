@@ -0,0 +1,103 @@
+#include <unistd.h>
+#include "jdtalk.h"
+
+/**
+ * Advance a splitmix64 generator
+ * @param x pointer to generator state
+ * @return next value
+ */
+static uint64_t rng_splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rng_rotl(const uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * Initialize a random number generator
+ *
+ * The same seed always produces the same sequence of numbers.
+ *
+ * @param rng pointer to generator
+ * @param seed initial value
+ */
+void rng_seed(struct Rng *rng, uint64_t seed) {
+    for (size_t i = 0; i < sizeof(rng->s) / sizeof(*rng->s); i++) {
+        rng->s[i] = rng_splitmix64(&seed);
+    }
+}
+
+/**
+ * Initialize one of many independent streams derived from a seed
+ *
+ * @param rng pointer to generator
+ * @param seed initial value shared by all streams
+ * @param stream stream number
+ */
+void rng_seed_stream(struct Rng *rng, uint64_t seed, uint64_t stream) {
+    uint64_t x = stream;
+    rng_seed(rng, seed ^ rng_splitmix64(&x));
+}
+
+/**
+ * Produce a seed that differs between runs
+ * @return seed
+ */
+uint64_t rng_seed_default() {
+    struct timespec ts;
+    uint64_t seed;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    seed = (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+    seed ^= (uint64_t) getpid() << 32;
+    return rng_splitmix64(&seed);
+}
+
+/**
+ * Produce a random 64-bit integer (xoshiro256**)
+ * @param rng pointer to generator
+ * @return random integer
+ */
+uint64_t rng_next(struct Rng *rng) {
+    uint64_t *s = rng->s;
+    const uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+/**
+ * Produce a random integer in the range [0, n) without modulo bias
+ *
+ * Uses Lemire's multiply-and-shift method. A second draw is only needed
+ * for the rare values that would bias the result.
+ *
+ * @param rng pointer to generator
+ * @param n upper bound (exclusive, must be greater than zero)
+ * @return random integer
+ */
+uint32_t rng_bounded(struct Rng *rng, uint32_t n) {
+    uint64_t m;
+    uint32_t low;
+
+    m = (uint64_t) (uint32_t) (rng_next(rng) >> 32) * n;
+    low = (uint32_t) m;
+    if (low < n) {
+        uint32_t threshold = -n % n;
+        while (low < threshold) {
+            m = (uint64_t) (uint32_t) (rng_next(rng) >> 32) * n;
+            low = (uint32_t) m;
+        }
+    }
+    return (uint32_t) (m >> 32);
+}
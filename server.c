@@ -0,0 +1,686 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "jdtalk.h"
+
+// Request read from a client, waiting for a worker
+struct ServerJob {
+    int fd;
+    char *data;             // arguments (see server_request_args)
+    size_t len;
+    size_t serial;          // number of requests received before this one
+    struct ServerJob *next;
+};
+
+// Client still sending its request
+struct ServerConn {
+    int fd;
+    struct StrBuf request;
+};
+
+struct ServerShared {
+    const struct Dictionary *dict;
+    const struct DictionaryView *view;
+    struct Cache *cache;        // phrases kept ready for frequent requests
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct ServerJob *head;     // oldest waiting request
+    struct ServerJob *tail;     // newest waiting request
+    int *active;                // client answered by each worker (-1=idle)
+    size_t nworkers;            // most generator threads a request may use
+    int stopping;
+};
+
+struct ServerWorker {
+    struct ServerShared *shared;
+    size_t id;
+    pthread_t thread;
+};
+
+// Written by the signal handler to wake the event loop
+static int server_wake[2] = { -1, -1 };
+
+/**
+ * Ask the event loop to stop
+ * @param sig signal number
+ */
+static void server_signal(int sig) {
+    int saved = errno;
+    (void) sig;
+    if (write(server_wake[1], "", 1) < 0) {
+        // A full pipe wakes the event loop just the same
+    }
+    errno = saved;
+}
+
+/**
+ * Make a file descriptor non-blocking and close it on exec
+ * @param fd file descriptor
+ * @param nonblock 1=non-blocking, 0=blocking
+ * @return 0=success, -1=failure (errno is set)
+ */
+static int server_fd_flags(int fd, int nonblock) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+        return -1;
+    }
+    flags = nonblock ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    return fcntl(fd, F_SETFL, flags);
+}
+
+/**
+ * Split a request into arguments
+ *
+ * A request is the number of arguments in decimal and a newline, followed
+ * by each argument and its NUL terminator. argv[0] is the program name.
+ *
+ * @param data request
+ * @param len length of request in bytes
+ * @param argv array receiving the arguments (SERVER_ARGS_MAX + 2, NULL terminated), or NULL to only check the request
+ * @return number of arguments, -1=incomplete, -2=malformed
+ */
+static int server_request_args(char *data, size_t len, char **argv) {
+    char *newline;
+    char *end;
+    char *arg;
+    long n;
+
+    newline = memchr(data, '\n', len);
+    if (!newline) {
+        return len > 16 ? -2 : -1;
+    }
+    if (!isdigit((unsigned char) *data)) {
+        return -2;
+    }
+    n = strtol(data, &end, 10);
+    if (end != newline || n > SERVER_ARGS_MAX) {
+        return -2;
+    }
+
+    arg = newline + 1;
+    for (long i = 0; i < n; i++) {
+        char *nul = memchr(arg, '\0', (size_t) (data + len - arg));
+        if (!nul) {
+            return -1;
+        }
+        if (argv) {
+            argv[i + 1] = arg;
+        }
+        arg = nul + 1;
+    }
+    if (arg != data + len) {
+        return -2;
+    }
+    if (argv) {
+        argv[0] = "jdtalkc";
+        argv[n + 1] = NULL;
+    }
+    return (int) n + 1;
+}
+
+/**
+ * Start the reply to a request
+ * @param out pointer to output stream of the client
+ * @param status exit status of the client
+ * @param error error message for the client ("" for none)
+ */
+static void server_reply(struct Output *out, int status, const char *error) {
+    size_t len = strlen(error);
+    output_printf(out, "%d %zu\n", status, len ? len + 1 : 0);
+    if (len) {
+        output_write(out, error, len);
+        output_write(out, "\n", 1);
+    }
+}
+
+/**
+ * Answer one request
+ * @param shared pointer to server state
+ * @param job pointer to request
+ */
+static void server_answer(struct ServerShared *shared, struct ServerJob *job) {
+    char *argv[SERVER_ARGS_MAX + 2];
+    struct Request req;
+    struct StrBuf errbuf;
+    struct StrBuf usage;
+    struct Output out;
+    int argc;
+
+    argc = server_request_args(job->data, job->len, argv);
+    request_init(&req);
+    // Requests arriving at the same moment still receive different phrases
+    req.opt.seed ^= (uint64_t) job->serial * 0x9e3779b97f4a7c15ULL;
+    strbuf_new(&errbuf, 0);
+    strbuf_new(&usage, 0);
+    output_init(&out, job->fd, OUTPUT_BULK);
+
+    if (request_parse(&req, argc, argv, &errbuf) < 0) {
+        server_reply(&out, 1, errbuf.data);
+        if (req.opt.do_usage) {
+            request_usage(argv[0], &usage);
+            output_write(&out, usage.data, usage.len);
+        }
+    } else if (req.opt.do_usage) {
+        server_reply(&out, 0, "");
+        request_usage(argv[0], &usage);
+        output_write(&out, usage.data, usage.len);
+    } else if (req.opt.do_cache_stats) {
+        server_reply(&out, 0, "");
+        cache_stats(shared->cache, &usage);
+        output_write(&out, usage.data, usage.len);
+    } else if (req.opt.do_compile || req.opt.serve || req.opt.do_benchmark) {
+        // The report of -b has nowhere to go
+        strbuf_printf(&errbuf, "%s can't be used in a request", req.opt.serve ? "--serve" : req.opt.do_compile ? "--compile-dict" : "-b");
+        server_reply(&out, 1, errbuf.data);
+    } else if (request_prepare(&req, shared->dict, shared->view, &errbuf) < 0) {
+        if (request_json(&req)) {
+            // The error goes out in the JSON output
+            server_reply(&out, 1, "");
+            request_error(&req, &out, &out, errbuf.data);
+        } else {
+            server_reply(&out, 1, errbuf.data);
+        }
+    } else {
+        // One client may not claim more threads than the server answers requests with
+        if (req.opt.threads > shared->nworkers) {
+            req.opt.threads = shared->nworkers;
+        }
+        server_reply(&out, 0, "");
+        request_run(&req, shared->view, cache_find(shared->cache, &req), &out, &errbuf);
+    }
+
+    output_close(&out);
+    request_free(&req);
+    strbuf_free(&usage);
+    strbuf_free(&errbuf);
+}
+
+/**
+ * Answer requests until the server stops
+ * @param arg pointer to ServerWorker
+ * @return NULL
+ */
+static void *server_worker(void *arg) {
+    struct ServerWorker *worker = arg;
+    struct ServerShared *shared = worker->shared;
+
+    while (1) {
+        struct ServerJob *job;
+
+        pthread_mutex_lock(&shared->lock);
+        while (!shared->head && !shared->stopping) {
+            pthread_cond_wait(&shared->ready, &shared->lock);
+        }
+        if (shared->stopping) {
+            pthread_mutex_unlock(&shared->lock);
+            break;
+        }
+        job = shared->head;
+        shared->head = job->next;
+        if (!shared->head) {
+            shared->tail = NULL;
+        }
+        shared->active[worker->id] = job->fd;
+        pthread_mutex_unlock(&shared->lock);
+
+        server_answer(shared, job);
+
+        pthread_mutex_lock(&shared->lock);
+        shared->active[worker->id] = -1;
+        pthread_mutex_unlock(&shared->lock);
+        close(job->fd);
+        free(job->data);
+        free(job);
+    }
+    return NULL;
+}
+
+/**
+ * Hand a complete request to the workers
+ * @param shared pointer to server state
+ * @param conn pointer to client (its request moves to the job)
+ * @param serial number of requests received before this one
+ */
+static void server_enqueue(struct ServerShared *shared, struct ServerConn *conn, size_t serial) {
+    struct ServerJob *job;
+
+    job = malloc(sizeof(*job));
+    if (!job) {
+        perror("Unable to allocate request");
+        exit(1);
+    }
+    // Workers write replies with blocking calls
+    server_fd_flags(conn->fd, 0);
+    job->fd = conn->fd;
+    job->data = conn->request.data;
+    job->len = conn->request.len;
+    job->serial = serial;
+    job->next = NULL;
+
+    pthread_mutex_lock(&shared->lock);
+    if (shared->tail) {
+        shared->tail->next = job;
+    } else {
+        shared->head = job;
+    }
+    shared->tail = job;
+    pthread_cond_signal(&shared->ready);
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ * Read what a client has sent so far
+ * @param conn pointer to client
+ * @return 1=request is complete, 0=waiting for more, -1=drop the client
+ */
+static int server_receive(struct ServerConn *conn) {
+    char buf[SERVER_BUFFER_SIZE];
+    ssize_t n;
+    int argc;
+
+    n = read(conn->fd, buf, sizeof(buf));
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    }
+    if (!n) {
+        // Closed before the request was complete
+        return -1;
+    }
+    strbuf_append(&conn->request, buf, (size_t) n);
+    if (conn->request.len > SERVER_REQUEST_MAX) {
+        return -1;
+    }
+    argc = server_request_args(conn->request.data, conn->request.len, NULL);
+    if (argc == -2) {
+        return -1;
+    }
+    return argc >= 0;
+}
+
+/**
+ * Create the listening socket
+ * @param path path of the socket
+ * @return file descriptor, or -1 on failure (errno is set)
+ */
+static int server_listen(const char *path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left behind by a previous server is replaced, anything else is left alone
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (server_fd_flags(fd, 1) < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SERVER_BACKLOG) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Answer requests on a Unix socket until SIGINT or SIGTERM
+ *
+ * An event loop accepts clients and collects their requests without
+ * blocking. Complete requests are answered by a pool of worker threads
+ * sharing the dictionary, so the dictionary is loaded only once.
+ *
+ * A request carries the options of a command line (see
+ * server_request_args). The reply begins with a line holding the exit
+ * status and the length of the error text that follows it. The rest of
+ * the reply is the output of the request.
+ *
+ * Unseeded requests take their lines from a phrase cache (see cache_find).
+ * Its counters are written to stderr when the server stops.
+ *
+ * @param path path of the socket
+ * @param opt pointer to options (workers and cache settings)
+ * @param dict pointer to indexed dictionary
+ * @param view array of dictionary views (indexed by word type)
+ * @return 0=success, -1=unable to serve (errno is set)
+ */
+int server_run(const char *path, const struct Options *opt, const struct Dictionary *dict, const struct DictionaryView *view) {
+    struct ServerShared shared;
+    struct Cache *cache;
+    struct StrBuf stats;
+    struct ServerWorker *workers;
+    struct ServerConn *conns;
+    struct pollfd *fds;
+    struct sigaction sa;
+    size_t nconns;
+    size_t nconns_alloc;
+    size_t serial;
+    size_t nworkers;
+    size_t started;
+    int listener;
+    int backoff;            // the last accept ran out of resources
+    int starved;            // out of resources since the last client was accepted
+
+    nworkers = opt->workers;
+    if (!nworkers) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = n > 0 ? (size_t) n : 1;
+    }
+
+    cache = cache_new(opt->cache_depth, opt->cache_low, opt->cache_high, dict, view);
+    if (!cache) {
+        errno = EINVAL;
+        return -1;
+    }
+    listener = server_listen(path);
+    if (listener < 0) {
+        int saved = errno;
+        cache_free(cache);
+        errno = saved;
+        return -1;
+    }
+    if (pipe(server_wake) < 0 || server_fd_flags(server_wake[0], 1) < 0 || server_fd_flags(server_wake[1], 1) < 0) {
+        int saved = errno;
+        cache_free(cache);
+        close(listener);
+        unlink(path);
+        errno = saved;
+        return -1;
+    }
+
+    // Clients that hang up must not take the server with them
+    signal(SIGPIPE, SIG_IGN);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    memset(&shared, 0, sizeof(shared));
+    shared.dict = dict;
+    shared.view = view;
+    shared.cache = cache;
+    shared.nworkers = nworkers;
+    pthread_mutex_init(&shared.lock, NULL);
+    pthread_cond_init(&shared.ready, NULL);
+    shared.active = malloc(nworkers * sizeof(*shared.active));
+    workers = calloc(nworkers, sizeof(*workers));
+    nconns_alloc = 16;
+    conns = malloc(nconns_alloc * sizeof(*conns));
+    fds = malloc((nconns_alloc + 2) * sizeof(*fds));
+    if (!shared.active || !workers || !conns || !fds) {
+        perror("Unable to allocate server");
+        exit(1);
+    }
+
+    for (started = 0; started < nworkers; started++) {
+        workers[started].shared = &shared;
+        workers[started].id = started;
+        shared.active[started] = -1;
+        if (pthread_create(&workers[started].thread, NULL, server_worker, &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    nconns = 0;
+    serial = 0;
+    backoff = 0;
+    starved = 0;
+    while (started) {
+        size_t npending;
+
+        // While out of descriptors the listener stays readable, so leave it alone for a while
+        fds[0].fd = backoff ? -1 : listener;
+        fds[0].events = POLLIN;
+        fds[1].fd = server_wake[0];
+        fds[1].events = POLLIN;
+        for (size_t i = 0; i < nconns; i++) {
+            fds[i + 2].fd = conns[i].fd;
+            fds[i + 2].events = POLLIN;
+        }
+        if (poll(fds, nconns + 2, backoff ? SERVER_ACCEPT_BACKOFF_MS : -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        backoff = 0;
+        if (fds[1].revents) {
+            break;
+        }
+
+        // Walk backward so a dropped client can be replaced by the last one
+        npending = nconns;
+        for (size_t i = npending; i > 0; i--) {
+            struct ServerConn *conn = &conns[i - 1];
+            int result;
+
+            if (!fds[i + 1].revents) {
+                continue;
+            }
+            result = server_receive(conn);
+            if (!result) {
+                continue;
+            }
+            if (result > 0) {
+                server_enqueue(&shared, conn, serial++);
+            } else {
+                close(conn->fd);
+                strbuf_free(&conn->request);
+            }
+            *conn = conns[--nconns];
+        }
+
+        if (fds[0].revents & POLLIN) {
+            while (1) {
+                int fd = accept(listener, NULL, NULL);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        // Out of descriptors or memory: clients wait in the backlog until some are released
+                        if (!starved) {
+                            fprintf(stderr, "Unable to accept client: %s\n", strerror(errno));
+                        }
+                        backoff = 1;
+                        starved = 1;
+                    }
+                    break;
+                }
+                starved = 0;
+                if (server_fd_flags(fd, 1) < 0) {
+                    close(fd);
+                    continue;
+                }
+                if (nconns == nconns_alloc) {
+                    nconns_alloc *= 2;
+                    conns = realloc(conns, nconns_alloc * sizeof(*conns));
+                    fds = realloc(fds, (nconns_alloc + 2) * sizeof(*fds));
+                    if (!conns || !fds) {
+                        perror("Unable to extend client list");
+                        exit(1);
+                    }
+                }
+                conns[nconns].fd = fd;
+                strbuf_new(&conns[nconns].request, 0);
+                nconns++;
+            }
+        }
+    }
+
+    // Cut off replies in progress so unlimited requests end too
+    pthread_mutex_lock(&shared.lock);
+    shared.stopping = 1;
+    for (size_t i = 0; i < started; i++) {
+        if (shared.active[i] >= 0) {
+            shutdown(shared.active[i], SHUT_RDWR);
+        }
+    }
+    pthread_cond_broadcast(&shared.ready);
+    pthread_mutex_unlock(&shared.lock);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    while (shared.head) {
+        struct ServerJob *job = shared.head;
+        shared.head = job->next;
+        close(job->fd);
+        free(job->data);
+        free(job);
+    }
+    for (size_t i = 0; i < nconns; i++) {
+        close(conns[i].fd);
+        strbuf_free(&conns[i].request);
+    }
+    close(listener);
+    unlink(path);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    close(server_wake[0]);
+    close(server_wake[1]);
+    server_wake[0] = server_wake[1] = -1;
+
+    strbuf_new(&stats, 0);
+    cache_stats(shared.cache, &stats);
+    fputs(stats.data, stderr);
+    strbuf_free(&stats);
+    cache_free(shared.cache);
+
+    free(fds);
+    free(conns);
+    free(workers);
+    free(shared.active);
+    pthread_cond_destroy(&shared.ready);
+    pthread_mutex_destroy(&shared.lock);
+    if (!started) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Send bytes to a socket
+ * @param fd file descriptor
+ * @param s bytes to send
+ * @param n number of bytes to send
+ * @return 0=success, -1=failure (errno is set)
+ */
+static int client_send(int fd, const char *s, size_t n) {
+    while (n) {
+        ssize_t sent = send(fd, s, n, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        s += sent;
+        n -= (size_t) sent;
+    }
+    return 0;
+}
+
+/**
+ * Send a command line to a server and print its reply
+ *
+ * @param path path of the server socket
+ * @param argc number of arguments (argv[0] is skipped)
+ * @param argv arguments
+ * @return exit status
+ */
+int client_run(const char *path, int argc, char *argv[]) {
+    struct sockaddr_un addr;
+    struct StrBuf request;
+    struct Output out;
+    struct Output err;
+    char header[64];
+    char buf[SERVER_BUFFER_SIZE];
+    size_t errleft;
+    size_t len;
+    int status;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Unable to connect to %s: %s\n", path, strerror(ENAMETOOLONG));
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Unable to connect to %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    strbuf_new(&request, 0);
+    strbuf_printf(&request, "%d\n", argc - 1);
+    for (int i = 1; i < argc; i++) {
+        strbuf_append(&request, argv[i], strlen(argv[i]) + 1);
+    }
+    if (client_send(fd, request.data, request.len) < 0) {
+        fprintf(stderr, "Unable to send request to %s: %s\n", path, strerror(errno));
+        strbuf_free(&request);
+        close(fd);
+        return 1;
+    }
+    strbuf_free(&request);
+
+    // The header is short, so it is read a byte at a time
+    for (len = 0; len < sizeof(header) - 1; len++) {
+        if (read(fd, &header[len], 1) != 1 || header[len] == '\n') {
+            break;
+        }
+    }
+    header[len] = '\0';
+    if (len == sizeof(header) - 1 || sscanf(header, "%d %zu", &status, &errleft) != 2) {
+        fprintf(stderr, "Malformed reply from %s\n", path);
+        close(fd);
+        return 1;
+    }
+
+    output_init(&out, STDOUT_FILENO, OUTPUT_AUTO);
+    output_init(&err, STDERR_FILENO, OUTPUT_LINE);
+    while (1) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        size_t nerr;
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        nerr = errleft < (size_t) n ? errleft : (size_t) n;
+        output_write(&err, buf, nerr);
+        errleft -= nerr;
+        if (output_write(&out, buf + nerr, (size_t) n - nerr) < 0) {
+            break;
+        }
+    }
+    close(fd);
+    output_close(&err);
+    if (output_close(&out) < 0) {
+        fprintf(stderr, "Unable to write output: %s\n", strerror(out.error));
+        return 1;
+    }
+    return status;
+}
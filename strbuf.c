@@ -0,0 +1,193 @@
+#include <stdarg.h>
+#include "jdtalk.h"
+
+/**
+ * Initialize a string builder over caller-owned storage
+ *
+ * The string never grows beyond storage. Appends that do not fit are
+ * truncated.
+ *
+ * struct StrBuf sb;
+ * char storage[100];
+ * strbuf_init(&sb, storage, sizeof(storage));
+ *
+ * @param sb pointer to string builder
+ * @param storage buffer receiving the string
+ * @param size size of storage in bytes (including the NUL terminator)
+ */
+void strbuf_init(struct StrBuf *sb, char *storage, size_t size) {
+    sb->data = storage;
+    sb->size = size;
+    sb->owned = 0;
+    strbuf_clear(sb);
+}
+
+/**
+ * Initialize a growable string builder
+ *
+ * struct StrBuf sb;
+ * strbuf_new(&sb, 0);
+ * strbuf_puts(&sb, "hello");
+ * strbuf_free(&sb);
+ *
+ * @param sb pointer to string builder
+ * @param size initial size in bytes (0=default)
+ */
+void strbuf_new(struct StrBuf *sb, size_t size) {
+    if (!size) {
+        size = STRBUF_INITIAL_SIZE;
+    }
+    sb->data = malloc(size);
+    if (!sb->data) {
+        perror("Unable to allocate string buffer");
+        exit(1);
+    }
+    sb->size = size;
+    sb->owned = 1;
+    strbuf_clear(sb);
+}
+
+/**
+ * Release the storage of a growable string builder
+ * @param sb pointer to string builder
+ */
+void strbuf_free(struct StrBuf *sb) {
+    if (sb->owned) {
+        free(sb->data);
+    }
+    sb->data = NULL;
+    sb->size = 0;
+    sb->len = 0;
+}
+
+/**
+ * Make room for more bytes
+ *
+ * Growable builders at least double in size, so a string of any length
+ * is built in linear time. Builders over caller-owned storage never grow.
+ *
+ * @param sb pointer to string builder
+ * @param n number of bytes to make room for (excluding the NUL terminator)
+ * @return 0=success, -1=not enough room
+ */
+int strbuf_reserve(struct StrBuf *sb, size_t n) {
+    size_t size;
+    char *data;
+
+    if (sb->len + n + 1 <= sb->size) {
+        return 0;
+    }
+    if (!sb->owned) {
+        return -1;
+    }
+    size = sb->size ? sb->size : STRBUF_INITIAL_SIZE;
+    while (size < sb->len + n + 1) {
+        size *= 2;
+    }
+    data = realloc(sb->data, size);
+    if (!data) {
+        perror("Unable to extend string buffer");
+        exit(1);
+    }
+    sb->data = data;
+    sb->size = size;
+    return 0;
+}
+
+/**
+ * Empty a string builder
+ * @param sb pointer to string builder
+ */
+void strbuf_clear(struct StrBuf *sb) {
+    sb->len = 0;
+    sb->truncated = 0;
+    if (sb->size) {
+        sb->data[0] = '\0';
+    }
+}
+
+/**
+ * Append bytes to a string builder
+ *
+ * Growable builders are extended as needed. Otherwise bytes that do not
+ * fit are dropped and the builder is marked truncated.
+ *
+ * @param sb pointer to string builder
+ * @param s bytes to append
+ * @param n number of bytes to append
+ * @return 0=success, -1=truncated
+ */
+int strbuf_append(struct StrBuf *sb, const char *s, size_t n) {
+    size_t avail;
+
+    strbuf_reserve(sb, n);
+    avail = sb->size ? sb->size - sb->len - 1 : 0;
+    if (n > avail) {
+        n = avail;
+        sb->truncated = 1;
+    }
+    memcpy(sb->data + sb->len, s, n);
+    sb->len += n;
+    if (sb->size) {
+        sb->data[sb->len] = '\0';
+    }
+    return sb->truncated ? -1 : 0;
+}
+
+/**
+ * Append a string to a string builder
+ * @param sb pointer to string builder
+ * @param s string to append
+ * @return 0=success, -1=truncated
+ */
+int strbuf_puts(struct StrBuf *sb, const char *s) {
+    return strbuf_append(sb, s, strlen(s));
+}
+
+/**
+ * Append a character to a string builder
+ * @param sb pointer to string builder
+ * @param ch character to append
+ * @return 0=success, -1=truncated
+ */
+int strbuf_putc(struct StrBuf *sb, char ch) {
+    if (sb->len + 2 <= sb->size) {
+        sb->data[sb->len++] = ch;
+        sb->data[sb->len] = '\0';
+        return sb->truncated ? -1 : 0;
+    }
+    return strbuf_append(sb, &ch, 1);
+}
+
+/**
+ * Append formatted text to a string builder
+ * @param sb pointer to string builder
+ * @param fmt printf format
+ * @return 0=success, -1=truncated or invalid format
+ */
+int strbuf_printf(struct StrBuf *sb, const char *fmt, ...) {
+    size_t avail;
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    avail = sb->size ? sb->size - sb->len : 0;
+    len = vsnprintf(sb->data + sb->len, avail, fmt, ap);
+    va_end(ap);
+    if (len < 0) {
+        return -1;
+    }
+    if ((size_t) len >= avail) {
+        if (strbuf_reserve(sb, (size_t) len) < 0) {
+            // Keep what fit
+            sb->len = avail ? sb->size - 1 : 0;
+            sb->truncated = 1;
+            return -1;
+        }
+        va_start(ap, fmt);
+        vsnprintf(sb->data + sb->len, sb->size - sb->len, fmt, ap);
+        va_end(ap);
+    }
+    sb->len += (size_t) len;
+    return sb->truncated ? -1 : 0;
+}
@@ -0,0 +1,279 @@
+#include "jdtalk.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STR_CASE_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Determine whether a set of transformations only changes letter case
+ *
+ * Such transformations are recorded per line with str_case_line and
+ * applied to a whole batch of lines at once with str_case_apply.
+ *
+ * @param flags STR_* transformations
+ * @return 0=no, 1=yes
+ */
+int str_case_batchable(unsigned flags) {
+    return flags && !(flags & ~(unsigned) (STR_RANDOM_CASE | STR_HILL_CASE | STR_TITLE_CASE));
+}
+
+/**
+ * Initialize a batch case conversion
+ * @param sc pointer to case conversion
+ * @param flags STR_RANDOM_CASE, STR_HILL_CASE and/or STR_TITLE_CASE
+ */
+void str_case_init(struct StrCase *sc, unsigned flags) {
+    sc->bits = NULL;
+    sc->nwords_alloc = 0;
+    sc->len = 0;
+    sc->flags = flags;
+}
+
+/**
+ * Release a batch case conversion
+ * @param sc pointer to case conversion
+ */
+void str_case_free(struct StrCase *sc) {
+    free(sc->bits);
+    sc->bits = NULL;
+    sc->nwords_alloc = 0;
+    sc->len = 0;
+}
+
+/**
+ * Forget the lines of a batch
+ * @param sc pointer to case conversion
+ */
+void str_case_clear(struct StrCase *sc) {
+    if (sc->bits) {
+        memset(sc->bits, 0, sc->nwords_alloc * sizeof(*sc->bits));
+    }
+    sc->len = 0;
+}
+
+/**
+ * Make room for the bits of a batch
+ *
+ * Two spare words let the kernels read 64 bits at any position.
+ *
+ * @param sc pointer to case conversion
+ * @param len length of batch in bytes
+ */
+static void str_case_reserve(struct StrCase *sc, size_t len) {
+    size_t nwords = len / 64 + 2;
+    uint64_t *bits;
+
+    if (nwords <= sc->nwords_alloc) {
+        return;
+    }
+    if (nwords < sc->nwords_alloc * 2) {
+        nwords = sc->nwords_alloc * 2;
+    }
+    bits = realloc(sc->bits, nwords * sizeof(*bits));
+    if (!bits) {
+        perror("Unable to allocate case bits");
+        exit(1);
+    }
+    memset(&bits[sc->nwords_alloc], 0, (nwords - sc->nwords_alloc) * sizeof(*bits));
+    sc->bits = bits;
+    sc->nwords_alloc = nwords;
+}
+
+/**
+ * Set bits of a batch
+ * @param bits bit array
+ * @param pos position of the first bit
+ * @param word bits to set
+ * @param n number of bits to set (1-64)
+ */
+static void str_case_put(uint64_t *bits, size_t pos, uint64_t word, size_t n) {
+    size_t shift = pos % 64;
+
+    if (n < 64) {
+        word &= (1ULL << n) - 1;
+    }
+    bits[pos / 64] |= word << shift;
+    if (shift) {
+        bits[pos / 64 + 1] |= word >> (64 - shift);
+    }
+}
+
+/**
+ * Read 64 bits of a batch
+ * @param bits bit array
+ * @param pos position of the first bit
+ * @return bits
+ */
+static inline uint64_t str_case_get(const uint64_t *bits, size_t pos) {
+    size_t shift = pos % 64;
+    uint64_t word = bits[pos / 64] >> shift;
+
+    if (shift) {
+        word |= bits[pos / 64 + 1] << (64 - shift);
+    }
+    return word;
+}
+
+/**
+ * Record the case conversion of a line in a batch
+ *
+ * The random stream advances exactly as it does for str_transform_r, so a
+ * batch produces the same lines as converting them one by one.
+ *
+ * @param sc pointer to case conversion
+ * @param pos position of the line in the batch
+ * @param len length of the line
+ * @param rng pointer to random number generator
+ */
+void str_case_line(struct StrCase *sc, size_t pos, size_t len, struct Rng *rng) {
+    str_case_reserve(sc, pos + len + 1);
+    if (sc->flags & STR_RANDOM_CASE) {
+        for (size_t i = 0; i < len; i += 64) {
+            str_case_put(sc->bits, pos + i, rng_next(rng), len - i < 64 ? len - i : 64);
+        }
+    }
+    if (sc->flags & STR_HILL_CASE) {
+        // Odd positions within the line
+        for (size_t i = 0; i < len; i += 64) {
+            str_case_put(sc->bits, pos + i, 0xaaaaaaaaaaaaaaaaULL, len - i < 64 ? len - i : 64);
+        }
+    }
+    if ((sc->flags & STR_TITLE_CASE) && len) {
+        // Later words are found by the kernels
+        str_case_put(sc->bits, pos, 1, 1);
+    }
+    if (pos + len > sc->len) {
+        sc->len = pos + len;
+    }
+}
+
+/**
+ * Convert characters to upper case one at a time
+ * @param s batch of lines
+ * @param start position of the first character to convert (greater than zero)
+ * @param end position after the last character to convert
+ * @param bits characters to convert regardless of their neighbors
+ * @param title convert characters following a space
+ */
+static void str_case_scalar(char *s, size_t start, size_t end, const uint64_t *bits, int title) {
+    for (size_t i = start; i < end; i++) {
+        int upper = (int) ((bits[i / 64] >> (i % 64)) & 1);
+        if (title && s[i - 1] == ' ') {
+            upper = 1;
+        }
+        if (upper && s[i] >= 'a' && s[i] <= 'z') {
+            s[i] = (char) (s[i] - 'a' + 'A');
+        }
+    }
+}
+
+#ifdef STR_CASE_X86
+/**
+ * Convert characters to upper case 16 at a time (SSE2)
+ * @see str_case_scalar
+ * @return position of the first character left to convert
+ */
+__attribute__((target("sse2")))
+static size_t str_case_sse2(char *s, size_t start, size_t end, const uint64_t *bits, int title) {
+    const __m128i select = _mm_set1_epi64x((long long) 0x8040201008040201ULL);
+    const __m128i below = _mm_set1_epi8('a' - 1);
+    const __m128i above = _mm_set1_epi8('z' + 1);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i;
+
+    for (i = start; i + 16 <= end; i += 16) {
+        uint64_t m = str_case_get(bits, i);
+        __m128i ch = _mm_loadu_si128((const __m128i *) &s[i]);
+        __m128i upper;
+        __m128i lower;
+
+        // Spread each bit over a byte
+        upper = _mm_set_epi64x((long long) (((m >> 8) & 0xff) * 0x0101010101010101ULL),
+                               (long long) ((m & 0xff) * 0x0101010101010101ULL));
+        upper = _mm_cmpeq_epi8(_mm_and_si128(upper, select), select);
+        if (title) {
+            __m128i prev = _mm_loadu_si128((const __m128i *) &s[i - 1]);
+            upper = _mm_or_si128(upper, _mm_cmpeq_epi8(prev, space));
+        }
+        lower = _mm_and_si128(_mm_cmpgt_epi8(ch, below), _mm_cmplt_epi8(ch, above));
+        upper = _mm_and_si128(upper, lower);
+        ch = _mm_xor_si128(ch, _mm_and_si128(upper, flip));
+        _mm_storeu_si128((__m128i *) &s[i], ch);
+    }
+    return i;
+}
+
+/**
+ * Convert characters to upper case 32 at a time (AVX2)
+ * @see str_case_scalar
+ * @return position of the first character left to convert
+ */
+__attribute__((target("avx2")))
+static size_t str_case_avx2(char *s, size_t start, size_t end, const uint64_t *bits, int title) {
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i select = _mm256_set1_epi64x((long long) 0x8040201008040201ULL);
+    const __m256i below = _mm256_set1_epi8('a' - 1);
+    const __m256i above = _mm256_set1_epi8('z' + 1);
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i;
+
+    for (i = start; i + 32 <= end; i += 32) {
+        uint32_t m = (uint32_t) str_case_get(bits, i);
+        __m256i ch = _mm256_loadu_si256((const __m256i *) &s[i]);
+        __m256i upper;
+        __m256i lower;
+
+        // Spread each bit over a byte
+        upper = _mm256_shuffle_epi8(_mm256_set1_epi32((int) m), spread);
+        upper = _mm256_cmpeq_epi8(_mm256_and_si256(upper, select), select);
+        if (title) {
+            __m256i prev = _mm256_loadu_si256((const __m256i *) &s[i - 1]);
+            upper = _mm256_or_si256(upper, _mm256_cmpeq_epi8(prev, space));
+        }
+        lower = _mm256_and_si256(_mm256_cmpgt_epi8(ch, below), _mm256_cmpgt_epi8(above, ch));
+        upper = _mm256_and_si256(upper, lower);
+        ch = _mm256_xor_si256(ch, _mm256_and_si256(upper, flip));
+        _mm256_storeu_si256((__m256i *) &s[i], ch);
+    }
+    return i;
+}
+#endif
+
+/**
+ * Apply the case conversion of a batch
+ *
+ * The widest kernel supported by the CPU converts the bulk of the batch,
+ * and the remaining characters are converted one at a time.
+ *
+ * @param sc pointer to case conversion
+ * @param s batch of lines (as recorded with str_case_line)
+ * @param len length of batch in bytes
+ */
+void str_case_apply(const struct StrCase *sc, char *s, size_t len) {
+    int title = (sc->flags & STR_TITLE_CASE) != 0;
+    size_t i;
+
+    if (!len || !sc->bits) {
+        return;
+    }
+    if (len > sc->len) {
+        len = sc->len;
+    }
+    // Byte 0 starts a line and has no neighbor to look at
+    if ((sc->bits[0] & 1) && s[0] >= 'a' && s[0] <= 'z') {
+        s[0] = (char) (s[0] - 'a' + 'A');
+    }
+    i = 1;
+#ifdef STR_CASE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        i = str_case_avx2(s, i, len, sc->bits, title);
+    } else if (__builtin_cpu_supports("sse2")) {
+        i = str_case_sse2(s, i, len, sc->bits, title);
+    }
+#endif
+    str_case_scalar(s, i, len, sc->bits, title);
+}
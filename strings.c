@@ -1,17 +1,80 @@
 #include "jdtalk.h"
 
+// Upper case of each character (C locale)
+static const unsigned char str_upper_table[256] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+    0x60, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+    0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+    0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+    0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+    0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+    0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+};
+
+// 1337 translation of a character (len=0 keeps the character)
+struct StrLeet {
+    const char *s;
+    size_t len;
+};
+#define STR_LEET_ENTRY(UPPER, LOWER, S) [UPPER] = { S, sizeof(S) - 1 }, [LOWER] = { S, sizeof(S) - 1 }
+static const struct StrLeet str_leet_table[256] = {
+    STR_LEET_ENTRY('A', 'a', "4"),
+    STR_LEET_ENTRY('B', 'b', "8"),
+    STR_LEET_ENTRY('C', 'c', "("),
+    STR_LEET_ENTRY('D', 'd', ")"),
+    STR_LEET_ENTRY('E', 'e', "3"),
+    STR_LEET_ENTRY('F', 'f', "ƒ"),
+    STR_LEET_ENTRY('G', 'g', "6"),
+    STR_LEET_ENTRY('H', 'h', "#"),
+    STR_LEET_ENTRY('I', 'i', "!"),
+    STR_LEET_ENTRY('J', 'j', "]"),
+    STR_LEET_ENTRY('K', 'k', "X"),
+    STR_LEET_ENTRY('L', 'l', "1"),
+    STR_LEET_ENTRY('M', 'm', "|\\/|"),
+    STR_LEET_ENTRY('N', 'n', "|\\|"),
+    STR_LEET_ENTRY('O', 'o', "0"),
+    STR_LEET_ENTRY('P', 'p', "|*"),
+    STR_LEET_ENTRY('Q', 'q', "9"),
+    STR_LEET_ENTRY('R', 'r', "|2"),
+    STR_LEET_ENTRY('S', 's', "$"),
+    STR_LEET_ENTRY('T', 't', "7"),
+    STR_LEET_ENTRY('U', 'u', "|_|"),
+    STR_LEET_ENTRY('V', 'v', "\\/"),
+    STR_LEET_ENTRY('W', 'w', "\\/\\/"),
+    STR_LEET_ENTRY('X', 'x', "><"),
+    STR_LEET_ENTRY('Y', 'y', "¥"),
+    STR_LEET_ENTRY('Z', 'z', "2"),
+};
+
 /**
  * Change case of a character... sometimes
  * @param s input string (modified)
+ * @param rng pointer to random number generator
  * @return pointer to s
  */
-char *str_random_case(char *s) {
+char *str_random_case(char *s, struct Rng *rng) {
     size_t len;
+    uint64_t bits;
     len = strlen(s);
+    bits = 0;
     for (size_t i = 0; i < len; i++) {
-        if ((random() % 100) >= 50) {
-            s[i] = (char)toupper(s[i]);
+        // One random bit per character
+        if (i % 64 == 0) {
+            bits = rng_next(rng);
+        }
+        if (bits & 1) {
+            s[i] = (char) str_upper_table[(unsigned char) s[i]];
         }
+        bits >>= 1;
     }
     return s;
 }
@@ -26,134 +89,56 @@ char *str_hill_case(char *s) {
     len = strlen(s);
     for (size_t i = 0; i < len; i++) {
         if (i % 2) {
-            s[i] = (char)toupper(s[i]);
+            s[i] = (char) str_upper_table[(unsigned char) s[i]];
         }
     }
     return s;
 }
 
+/**
+ * Append the 1337 translation of a character
+ * @param ch character
+ * @param out string builder receiving the translation (appended)
+ */
+static inline void str_leet_putc(unsigned char ch, struct StrBuf *out) {
+    const struct StrLeet *leet = &str_leet_table[ch];
+    if (leet->len) {
+        strbuf_append(out, leet->s, leet->len);
+    } else {
+        strbuf_putc(out, (char) ch);
+    }
+}
+
+/**
+ * Translate characters to 1337
+ * @param s input string
+ * @param out string builder receiving the translation (appended)
+ * @return 0=success, -1=truncated
+ */
+int str_leet_r(const char *s, struct StrBuf *out) {
+    for (; *s; s++) {
+        str_leet_putc((unsigned char) *s, out);
+    }
+    return out->truncated ? -1 : 0;
+}
+
 /**
  * Translate characters to 1337
+ *
+ * Not reentrant. See str_leet_r.
+ *
  * @param s input string
  * @return pointer to local storage (don't free it)
  */
 char *str_leet(char *s) {
-    size_t len;
-    static char buf[OUTPUT_SIZE_MAX];
-    memset(buf, '\0', sizeof(buf));
-    len = strlen(s);
-    for (size_t i = 0; i < len; i++) {
-        switch (s[i]) {
-            case 'a':
-            case 'A':
-                strcat(buf, "4");
-                break;
-            case 'b':
-            case 'B':
-                strcat(buf, "8");
-                break;
-            case 'c':
-            case 'C':
-                strcat(buf, "(");
-                break;
-            case 'd':
-            case 'D':
-                strcat(buf, ")");
-                break;
-            case 'e':
-            case 'E':
-                strcat(buf, "3");
-                break;
-            case 'f':
-            case 'F':
-                strcat(buf, "ƒ");
-                break;
-            case 'g':
-            case 'G':
-                strcat(buf, "6");
-                break;
-            case 'h':
-            case 'H':
-                strcat(buf, "#");
-                break;
-            case 'i':
-            case 'I':
-                strcat(buf, "!");
-                break;
-            case 'j':
-            case 'J':
-                strcat(buf, "]");
-                break;
-            case 'k':
-            case 'K':
-                strcat(buf, "X");
-                break;
-            case 'l':
-            case 'L':
-                strcat(buf, "1");
-                break;
-            case 'm':
-            case 'M':
-                strcat(buf, "|\\/|");
-                break;
-            case 'n':
-            case 'N':
-                strcat(buf, "|\\|");
-                break;
-            case 'o':
-            case 'O':
-                strcat(buf, "0");
-                break;
-            case 'p':
-            case 'P':
-                strcat(buf, "|*");
-                break;
-            case 'q':
-            case 'Q':
-                strcat(buf, "9");
-                break;
-            case 'r':
-            case 'R':
-                strcat(buf, "|2");
-                break;
-            case 's':
-            case 'S':
-                strcat(buf, "$");
-                break;
-            case 't':
-            case 'T':
-                strcat(buf, "7");
-                break;
-            case 'u':
-            case 'U':
-                strcat(buf, "|_|");
-                break;
-            case 'v':
-            case 'V':
-                strcat(buf, "\\/");
-                break;
-            case 'w':
-            case 'W':
-                strcat(buf, "\\/\\/");
-                break;
-            case 'x':
-            case 'X':
-                strcat(buf, "><");
-                break;
-            case 'y':
-            case 'Y':
-                strcat(buf, "¥");
-                break;
-            case 'z':
-            case 'Z':
-                strcat(buf, "2");
-                break;
-            default:
-                buf[strlen(buf)] = s[i];
-                break;
-        }
+    static struct StrBuf sb;
+
+    if (!sb.owned) {
+        strbuf_new(&sb, 0);
     }
-    return buf;
+    strbuf_clear(&sb);
+    str_leet_r(s, &sb);
+    return sb.data;
 }
 
 /**
@@ -167,73 +152,160 @@ char *str_title_case(char *s) {
 
     i = 0;
     len = strlen(s);
-    s[i] = (char) toupper(s[i]);
+    s[i] = (char) str_upper_table[(unsigned char) s[i]];
     for (; i < len; i++) {
         if (i < len - 1 && s[i] == ' ') {
-            s[i + 1] = (char) toupper(s[i + 1]);
+            s[i + 1] = (char) str_upper_table[(unsigned char) s[i + 1]];
         }
     }
     return s;
 }
 
 /**
- * Randomize characters in a string
+ * Randomize characters in a span of a string
  * @param s input string (modified)
- * @return pointer to s
+ * @param len number of characters to randomize
+ * @param rng pointer to random number generator
  */
-char *str_randomize(char *s) {
-    size_t len;
+static void str_randomize_n(char *s, size_t len, struct Rng *rng) {
     char tmp = 0;
-    len = strlen(s);
+    if (len < 2) {
+        return;
+    }
     for (size_t i = len - 1; i > 0; i--) {
-        size_t from = random() % i + 1;
+        size_t from = rng_bounded(rng, (uint32_t) i) + 1;
         tmp = s[from];
         s[from] = s[i];
         s[i] = tmp;
     }
+}
+
+/**
+ * Randomize characters in a string
+ * @param s input string (modified)
+ * @param rng pointer to random number generator
+ * @return pointer to s
+ */
+char *str_randomize(char *s, struct Rng *rng) {
+    str_randomize_n(s, strlen(s), rng);
     return s;
 }
 
 /**
  * Randomize words in a string
  * @param s input string (modified)
+ * @param rng pointer to random number generator
  * @return pointer to s
  */
-char *str_randomize_words(char *s) {
-    char old[OUTPUT_SIZE_MAX];
-    char buf[OUTPUT_SIZE_MAX];
-    char *oldp;
+char *str_randomize_words(char *s, struct Rng *rng) {
     char *word;
 
-    strcpy(old, s);
-    oldp = old;
-    memset(buf, '\0', sizeof(buf));
-    size_t len = strlen(s);
-
-    while ((word = strsep(&oldp, " ")) != NULL) {
-        str_randomize(word);
-        strcat(buf, word);
-        strcat(buf, " ");
+    for (word = s; ; ) {
+        size_t len = strcspn(word, " ");
+        str_randomize_n(word, len, rng);
+        if (!word[len]) {
+            break;
+        }
+        word += len + 1;
     }
-    strncpy(s, buf, len);
     return s;
 }
 
+/**
+ * Reverse characters in a span of a string
+ * @param s input string (modified)
+ * @param len number of characters to reverse
+ */
+static void str_reverse_n(char *s, size_t len) {
+    for (size_t left = 0, right = len; left + 1 < right; left++, right--) {
+        char tmp = s[left];
+        s[left] = s[right - 1];
+        s[right - 1] = tmp;
+    }
+}
+
 /**
  * Reverse all characters in a string
  * @param s input string (modified)
  * @return pointer to s
  */
 char *str_reverse(char *s) {
-    size_t dest;
-    char buf[OUTPUT_SIZE_MAX];
-    buf[0] = '\0';
+    str_reverse_n(s, strlen(s));
+    return s;
+}
+
+/**
+ * Apply several transformations to a string in one pass
+ *
+ * The result is the same as applying str_random_case, str_hill_case,
+ * str_leet, str_title_case, str_randomize_words and str_reverse in that
+ * order, drawing the same random numbers. Case changes are decided per
+ * input character and looked up in a table, 1337 translations are
+ * written straight to out, and each word is shuffled as soon as it is
+ * complete. Reversal runs in place once the string is complete.
+ *
+ * @param s input string
+ * @param len length of s
+ * @param flags transformations to apply (STR_*)
+ * @param rng pointer to random number generator
+ * @param out string builder receiving the result (appended)
+ * @return 0=success, -1=truncated
+ */
+int str_transform_r(const char *s, size_t len, unsigned flags, struct Rng *rng, struct StrBuf *out) {
+    struct Rng case_rng;
+    uint64_t bits;
+    size_t start;
+    size_t word;
 
-    dest = 0;
-    for (size_t src = strlen(s); src > 0; src--, dest++) {
-        buf[dest] = s[src - 1];
+    if (flags & STR_RANDOM_CASE) {
+        // The case bits come first in the random stream, as if random case ran on its own
+        case_rng = *rng;
+        for (size_t i = 0; i < len; i += 64) {
+            rng_next(rng);
+        }
     }
-    buf[dest] = '\0';
-    strcpy(s, buf);
-    return s;
-}
\ No newline at end of file
+
+    strbuf_reserve(out, flags & STR_LEET ? len * STR_LEET_MAX : len);
+    start = out->len;
+    word = out->len;
+    bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char) s[i];
+        int upper = 0;
+
+        if (flags & STR_RANDOM_CASE) {
+            if (i % 64 == 0) {
+                bits = rng_next(&case_rng);
+            }
+            upper = (int) (bits & 1);
+            bits >>= 1;
+        }
+        if ((flags & STR_HILL_CASE) && i % 2) {
+            upper = 1;
+        }
+        if ((flags & STR_TITLE_CASE) && (i == 0 || s[i - 1] == ' ')) {
+            // 1337 translations never produce spaces, so the first character of a word stays first
+            upper = 1;
+        }
+        if (upper) {
+            ch = str_upper_table[ch];
+        }
+
+        if (ch == ' ' && (flags & STR_SHUFFLE)) {
+            str_randomize_n(&out->data[word], out->len - word, rng);
+            word = out->len + 1;
+        }
+        if (flags & STR_LEET) {
+            str_leet_putc(ch, out);
+        } else {
+            strbuf_putc(out, (char) ch);
+        }
+    }
+    if (flags & STR_SHUFFLE) {
+        str_randomize_n(&out->data[word], out->len - word, rng);
+    }
+    if (flags & STR_REVERSE) {
+        str_reverse_n(&out->data[start], out->len - start);
+    }
+    return out->truncated ? -1 : 0;
+}
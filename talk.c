@@ -1,5 +1,236 @@
 #include "jdtalk.h"
 
+/**
+ * Initialize a generator context
+ *
+ * The views are shared and never modified. Each thread needs its own
+ * context and random number generator.
+ *
+ * @param ctx pointer to generator context
+ * @param view array of dictionary views (indexed by word type)
+ * @param rng pointer to random number generator
+ */
+void talk_init(struct Talk *ctx, const struct DictionaryView *view, struct Rng *rng) {
+    ctx->view = view;
+    ctx->rng = rng;
+    ctx->plant = NULL;
+    ctx->plant_slot = 0;
+    ctx->redrawn = 0;
+}
+
+/**
+ * Choose the position of the planted word in the next phrase
+ *
+ * The position is the first to hold the planted word, drawn from the
+ * distribution of first matches among freely generated phrases.
+ *
+ * @param ctx pointer to generator context (ctx->plant must be set)
+ */
+void talk_plant_choose(struct Talk *ctx) {
+    const struct TalkPlant *plant = ctx->plant;
+    double pick;
+    size_t lo, hi;
+
+    pick = (double) (rng_next(ctx->rng) >> 11) * 0x1.0p-53 * plant->first[plant->nslots - 1];
+    lo = 0;
+    hi = plant->nslots - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (plant->first[mid] > pick) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    ctx->plant_slot = lo;
+}
+
+/**
+ * Determine whether a word satisfies the planted search pattern
+ * @param plant pointer to plant
+ * @param word word
+ * @return 0=no, 1=yes
+ */
+int talk_plant_satisfies(const struct TalkPlant *plant, const char *word) {
+    if (plant->exact) {
+        return strcmp(word, plant->pattern) == 0;
+    }
+    return strstr(word, plant->pattern) != NULL;
+}
+
+/**
+ * Get the planted word of a position
+ *
+ * The word is drawn from the words of the position satisfying the
+ * search pattern.
+ *
+ * @param ctx pointer to generator context
+ * @param i position in the phrase
+ * @return planted word, or NULL if the position is drawn at random
+ */
+static const char *talk_plant_word(struct Talk *ctx, size_t i) {
+    const struct TalkPlantSlot *slot;
+    double pick;
+    size_t g;
+
+    if (!ctx->plant || i != ctx->plant_slot) {
+        return NULL;
+    }
+    slot = &ctx->plant->config[ctx->plant->slot[i]];
+    pick = (double) (rng_next(ctx->rng) >> 11) * 0x1.0p-53;
+    for (g = 0; g < slot->ngroups - 1 && pick >= slot->weight[g]; g++);
+    while (!slot->count[g]) {
+        // Rounding carried the pick past the last usable group
+        g--;
+    }
+    return slot->words[g][rng_bounded(ctx->rng, (uint32_t) slot->count[g])];
+}
+
+/**
+ * Determine whether a random word must be drawn again
+ *
+ * Positions before the planted word must not satisfy the search pattern,
+ * so the planted position stays the first to satisfy it.
+ *
+ * @param ctx pointer to generator context
+ * @param i position in the phrase
+ * @param word random word
+ * @return 0=keep word, 1=draw again
+ */
+static int talk_plant_avoid(struct Talk *ctx, size_t i, const char *word) {
+    if (ctx->plant && i < ctx->plant_slot && word && talk_plant_satisfies(ctx->plant, word)) {
+        ctx->redrawn++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Record a part of a phrase
+ * @param parts array of parts (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @param i position of part
+ * @param word part to record
+ * @return 0=recorded, -1=parts is full
+ */
+static int talk_part(const char **parts, size_t parts_max, size_t i, const char *word) {
+    if (!parts) {
+        return 0;
+    }
+    if (i >= parts_max) {
+        return -1;
+    }
+    parts[i] = word;
+    return 0;
+}
+
+/**
+ * Get the type of word selected by a format character
+ * @param ch format character (a, d, n, v, x)
+ * @return type of word (WT_*), or -1 if ch is invalid
+ */
+int talk_format_type(char ch) {
+    switch (ch) {
+        case 'x':
+            return WT_ANY;
+        case 'a':
+            return WT_ADJECTIVE;
+        case 'd':
+            return WT_ADVERB;
+        case 'n':
+            return WT_NOUN;
+        case 'v':
+            return WT_VERB;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Produce a random word for a format character
+ * @param ctx pointer to generator context
+ * @param ch format character (a, d, n, v, x)
+ * @return pointer to dictionary word, or NULL if ch is invalid
+ */
+static const char *talk_word(struct Talk *ctx, char ch) {
+    int type = talk_format_type(ch);
+    if (type < 0) {
+        fprintf(stderr, "INVALID FORMAT: %x\n", ch);
+        return NULL;
+    }
+    return dictionary_word(&ctx->view[type], ctx->rng);
+}
+
+/**
+ * Describe the source of the word of a format token
+ * @param op pointer to format token
+ * @param pool array receiving the pools (TALK_POOL_MAX)
+ * @return number of pools
+ */
+size_t talk_format_pools(const struct FormatOp *op, struct TalkPool *pool) {
+    memset(pool, 0, sizeof(*pool));
+    pool->letter = -1;
+    pool->weight = 1;
+    if (op->view) {
+        pool->type = (int) op->view->type;
+    } else {
+        pool->type = -1;
+        pool->list = &op->literal;
+        pool->nlist = 1;
+    }
+    return 1;
+}
+
+/**
+ * Produce an output string from a compiled format
+ *
+ * struct Format plan;
+ * const char *parts[1024];
+ * format_compile(&plan, "a2n{and}v", view);
+ * talk_plan_r(&ctx, &plan, &sb, parts, 1024);
+ *
+ * @param ctx pointer to generator context
+ * @param plan pointer to compiled format (see format_compile)
+ * @param out string builder receiving the words (appended)
+ * @param parts array receiving a pointer to each word (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @return number of tokens produced
+ */
+int talk_plan_r(struct Talk *ctx, const struct Format *plan, struct StrBuf *out, const char **parts, size_t parts_max) {
+    size_t i;
+
+    strbuf_reserve(out, plan->expected);
+    for (i = 0; i < plan->nops; i++) {
+        const struct FormatOp *op = &plan->op[i];
+        const char *word;
+        size_t len;
+
+        word = talk_plant_word(ctx, i);
+        if (word) {
+            len = strlen(word);
+        } else {
+            do {
+                if (op->view) {
+                    word = dictionary_word_len(op->view, ctx->rng, &len);
+                } else {
+                    word = op->literal;
+                    len = op->len;
+                }
+            } while (talk_plant_avoid(ctx, i, word));
+        }
+
+        if (talk_part(parts, parts_max, i, word) < 0) {
+            // We reached the maximum number of parts. Stop processing.
+            break;
+        }
+        if (i) {
+            strbuf_putc(out, ' ');
+        }
+        strbuf_append(out, word, len);
+    }
+    return (int) i;
+}
+
 /**
  * Produce an output string containing various user-defined types of words
  *
@@ -9,160 +240,370 @@
  * v = verb
  * x = any
  *
- * char *parts[1024]; // probably more than enough, right?
- * talkf(dict, "adnvx", &parts);
+ * See format_compile for the rest of the syntax. The format is compiled
+ * on every call. Use talk_plan_r to produce many strings from one format.
  *
- * @param dict pointer to dictionary array
- * @param fmt
- * @param parts
- * @return
+ * const char *parts[1024];
+ * talkf_r(&ctx, "adnvx", &sb, parts, 1024);
+ *
+ * @param ctx pointer to generator context
+ * @param fmt output format
+ * @param out string builder receiving the words (appended)
+ * @param parts array receiving a pointer to each word (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @return number of tokens produced, or -1 if fmt is empty or invalid
  */
-char *talkf(struct Dictionary *dict[], char *fmt, char **parts, size_t parts_max) {
-    static char buf[OUTPUT_SIZE_MAX];
-    buf[0] = '\0';
+int talkf_r(struct Talk *ctx, const char *fmt, struct StrBuf *out, const char **parts, size_t parts_max) {
+    struct Format plan;
+    int result;
 
-    if (!fmt || !strlen(fmt)) {
-        return NULL;
+    if (format_compile(&plan, fmt, ctx->view) < 0) {
+        return -1;
     }
+    result = talk_plan_r(ctx, &plan, out, parts, parts_max);
+    format_free(&plan);
+    return result;
+}
 
-    size_t len;
-    len = strlen(fmt);
-    for (size_t i = 0; i < len; i++) {
-        char *word = NULL;
-        switch (fmt[i]) {
-            case 'x':
-                word = dictionary_word(dict[WT_ANY], WT_ANY);
-                break;
-            case 'a':
-                word = dictionary_word(dict[WT_ADJECTIVE], WT_ADJECTIVE);
-                break;
-            case 'd':
-                word = dictionary_word(dict[WT_ADVERB], WT_ADVERB);
-                break;
-            case 'n':
-                word = dictionary_word(dict[WT_NOUN], WT_NOUN);
-                break;
-            case 'v':
-                word = dictionary_word(dict[WT_VERB], WT_VERB);
-                break;
-            default:
-                fprintf(stderr, "INVALID FORMAT: %x\n", fmt[i]);
-                break;
-        }
-
-        if (parts) {
-            if (i < parts_max) {
-                parts[i] = word;
-            } else {
-                // We reached the maximum number of parts. Stop processing.
-                break;
-            }
+/**
+ * Produce a string of random words of any type
+ *
+ * @param ctx pointer to generator context
+ * @param limit number of words
+ * @param out string builder receiving the words (appended)
+ * @param parts array receiving a pointer to each word (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @return number of words produced
+ */
+int talk_salad_r(struct Talk *ctx, size_t limit, struct StrBuf *out, const char **parts, size_t parts_max) {
+    size_t i;
+    for (i = 0; i < limit; i++) {
+        const char *word = talk_plant_word(ctx, i);
+        if (!word) {
+            do {
+                word = talk_word(ctx, 'x');
+            } while (talk_plant_avoid(ctx, i, word));
         }
-
-        if (word) {
-            strncat(buf, word, OUTPUT_SIZE_MAX);
-            if (i < len - 1)
-                strcat(buf, " ");
+        if (talk_part(parts, parts_max, i, word) < 0) {
+            break;
+        }
+        if (i) {
+            strbuf_putc(out, ' ');
         }
+        strbuf_puts(out, word);
     }
-    return buf;
+    return (int) i;
 }
 
-char *talk_salad(struct Dictionary *dict[], size_t limit, char **parts, size_t parts_max) {
-    static char buf[OUTPUT_SIZE_MAX];
-    buf[0] = '\0';
-    for (size_t i = 0; i < limit; i++) {
-        strncat(buf, talkf(dict, "x", parts, parts_max), OUTPUT_SIZE_MAX);
-        if (i < limit - 1) {
-            strcat(buf, " ");
+// Word types of heart phrases (format characters)
+static const char talk_heart_seq[] = {
+    'v', 'd', 'x'
+};
+#define TALK_HEART_SEQ_LEN (sizeof(talk_heart_seq) / sizeof(*talk_heart_seq))
+
+// Leading pronouns of heart phrases
+static const char *talk_heart_prefix[] = {
+    "i", "you", "a", "be", "we", "my"
+};
+#define TALK_HEART_PREFIX_LEN (sizeof(talk_heart_prefix) / sizeof(*talk_heart_prefix))
+
+/**
+ * Weigh the word types of heart phrases
+ *
+ * Each type is weighed by the share of its words that are short enough.
+ *
+ * @param view array of dictionary views (indexed by word type)
+ * @param word_maxlen maximum length of each word
+ * @param weight array receiving the weight of each element of talk_heart_seq
+ * @return sum of weights (0=no word is short enough)
+ */
+static double talk_heart_weights(const struct DictionaryView *view, size_t word_maxlen, double *weight) {
+    double total = 0;
+    for (size_t i = 0; i < TALK_HEART_SEQ_LEN; i++) {
+        const struct DictionaryView *v = &view[talk_format_type(talk_heart_seq[i])];
+        weight[i] = 0;
+        if (v->count) {
+            weight[i] = (double) dictionary_count_short(v, word_maxlen) / (double) v->count;
         }
+        total += weight[i];
     }
-    return buf;
+    return total;
 }
 
-char *talk_heart(struct Dictionary *dict[], size_t word_limit, size_t word_maxlen, char **parts, size_t parts_max) {
-    char *seq[] = {
-    "v", "d", "x"
-    };
-    const char *prefix[] = {
-    "i", "you", "a", "be", "we", "my"
-    };
-    static char buf[OUTPUT_SIZE_MAX];
-    buf[0] = '\0';
-
-    sprintf(buf, "%s ", prefix[random() % sizeof(prefix) / sizeof(*prefix)]);
-    for (size_t i = 1; i < word_limit; ) {
-        char *word = talkf(dict, seq[random() % sizeof(seq) / sizeof(*seq)], parts, parts_max);
-        if (strlen(word) <= word_maxlen) {
-            strcat(buf, word);
-            if (i < word_limit - 1) {
-                strcat(buf, " ");
-            }
-            i++;
+/**
+ * Produce a random short word of a heart phrase
+ * @param ctx pointer to generator context
+ * @param weight weights of talk_heart_seq (see talk_heart_weights)
+ * @param total sum of weights (must be greater than zero)
+ * @param word_maxlen maximum length of the word
+ * @return pointer to dictionary word
+ */
+static const char *talk_heart_word(struct Talk *ctx, const double *weight, double total, size_t word_maxlen) {
+    double pick;
+    size_t t;
+
+    pick = (double) (rng_next(ctx->rng) >> 11) * 0x1.0p-53 * total;
+    for (t = 0; t < TALK_HEART_SEQ_LEN - 1 && pick >= weight[t]; t++) {
+        pick -= weight[t];
+    }
+    while (!weight[t]) {
+        // Rounding carried the pick past the last usable type
+        t--;
+    }
+    return dictionary_word_short(&ctx->view[talk_format_type(talk_heart_seq[t])], word_maxlen, ctx->rng);
+}
+
+/**
+ * Describe the sources of the word in a position of a heart phrase
+ * @param view array of dictionary views (indexed by word type)
+ * @param word_maxlen maximum length of each word
+ * @param slot position in the phrase (0=leading pronoun)
+ * @param pool array receiving the pools (TALK_POOL_MAX)
+ * @return number of pools
+ */
+size_t talk_heart_pools(const struct DictionaryView *view, size_t word_maxlen, size_t slot, struct TalkPool *pool) {
+    double weight[TALK_HEART_SEQ_LEN];
+    double total;
+
+    if (!slot) {
+        memset(pool, 0, sizeof(*pool));
+        pool->type = -1;
+        pool->letter = -1;
+        pool->weight = 1;
+        pool->list = talk_heart_prefix;
+        pool->nlist = TALK_HEART_PREFIX_LEN;
+        return 1;
+    }
+
+    total = talk_heart_weights(view, word_maxlen, weight);
+    for (size_t i = 0; i < TALK_HEART_SEQ_LEN; i++) {
+        memset(&pool[i], 0, sizeof(*pool));
+        pool[i].type = talk_format_type(talk_heart_seq[i]);
+        pool[i].letter = -1;
+        pool[i].maxlen = word_maxlen;
+        pool[i].weight = total ? weight[i] / total : 0;
+    }
+    return TALK_HEART_SEQ_LEN;
+}
+
+/**
+ * Produce a short phrase of short words
+ *
+ * Each word after the leading pronoun is a verb, an adverb, or any word.
+ * The type is chosen with a probability proportional to the share of its
+ * words that are short enough, and the word is then drawn directly from
+ * the short words of that type (see index_length).
+ *
+ * @param ctx pointer to generator context
+ * @param word_limit number of words (including the leading pronoun)
+ * @param word_maxlen maximum length of each word
+ * @param out string builder receiving the words (appended)
+ * @param parts array receiving a pointer to each word (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @return number of words produced, or -1 if no word is short enough
+ */
+int talk_heart_r(struct Talk *ctx, size_t word_limit, size_t word_maxlen, struct StrBuf *out, const char **parts, size_t parts_max) {
+    double weight[TALK_HEART_SEQ_LEN];
+    double total;
+    const char *word;
+    size_t i;
+
+    total = talk_heart_weights(ctx->view, word_maxlen, weight);
+    if (word_limit > 1 && total == 0) {
+        return -1;
+    }
+
+    word = talk_plant_word(ctx, 0);
+    if (!word) {
+        do {
+            word = talk_heart_prefix[rng_bounded(ctx->rng, TALK_HEART_PREFIX_LEN)];
+        } while (talk_plant_avoid(ctx, 0, word));
+    }
+    talk_part(parts, parts_max, 0, word);
+    strbuf_puts(out, word);
+    for (i = 1; i < word_limit; i++) {
+        word = talk_plant_word(ctx, i);
+        if (!word) {
+            do {
+                word = talk_heart_word(ctx, weight, total, word_maxlen);
+            } while (talk_plant_avoid(ctx, i, word));
         }
+        if (talk_part(parts, parts_max, i, word) < 0) {
+            break;
+        }
+        strbuf_putc(out, ' ');
+        strbuf_puts(out, word);
     }
-    return buf;
+    return (int) i;
 }
 
-char *talk_acronym(struct Dictionary *dict[], char *fmt, char *s, char **parts, size_t parts_max) {
-    size_t s_len;
-    static char buf[OUTPUT_SIZE_MAX];
-    static char *local_parts[OUTPUT_PART_MAX];
-    buf[0] = '\0';
-    s_len = strlen(s);
-    /*
-    size_t format_len;
-    char format[INPUT_SIZE_MAX];
-    format[0] = '\0';
-    if (fmt) {
-        strcpy(format, fmt);
-    } else {
-        strcpy(format, "x");
-    }
-
-    format_len = strlen(fmt);
-    if (format_len > s_len) {
-        *(format + s_len) = '\0';
-    }
-
-    size_t x;
-    x = 0;
-     */
-    for (size_t i = 0; i < s_len; i++) {
-        char word[OUTPUT_SIZE_MAX];
-        word[0] = '\0';
-        while(1) {
-            // Disable formatted output (again!)
-            //char elem[2] = {0, 0};
-            //elem[0] = format[x];
-            strcpy(word, talkf(dict, "x", &local_parts[i], parts_max));
-            if (*word == s[i]) {
-                strncat(buf, word, OUTPUT_SIZE_MAX);
-                if (i < s_len - 1) {
-                    strcat(buf, " ");
-                }
-                break;
-            }
+/**
+ * Get the format token applied to a position of an acronym
+ *
+ * Each token applies to the character of the acronym at the same
+ * position. The last token applies to the rest.
+ *
+ * @param plan pointer to compiled format
+ * @param i position in the acronym
+ * @return pointer to format token
+ */
+static const struct FormatOp *talk_acronym_op(const struct Format *plan, size_t i) {
+    return &plan->op[i < plan->nops ? i : plan->nops - 1];
+}
+
+/**
+ * Produce a phrase whose words begin with each character of a string
+ *
+ * Words are drawn directly from the words of the requested type sharing
+ * the character (see index_letter).
+ *
+ * @param ctx pointer to generator context
+ * @param plan compiled format applied to each character of s (words only)
+ * @param s acronym
+ * @param out string builder receiving the words (appended)
+ * @param parts array receiving a pointer to each word (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @return number of words produced, or -1 if no word fits a character of s
+ */
+int talk_acronym_r(struct Talk *ctx, const struct Format *plan, const char *s, struct StrBuf *out, const char **parts, size_t parts_max) {
+    size_t i;
+
+    for (i = 0; s[i] != '\0'; i++) {
+        const struct FormatOp *op = talk_acronym_op(plan, i);
+        const char *word;
+
+        if (!op->view) {
+            return -1;
         }
-        if (parts) {
-            if (i < parts_max) {
-                //printf("parts[%zu]=%s\n", i, word);
-                parts[i] = local_parts[i];
-            } else {
-                // We reached the maximum number of parts. Stop processing.
-                break;
-            }
+        word = talk_plant_word(ctx, i);
+        if (!word) {
+            do {
+                word = dictionary_word_letter(op->view, s[i], ctx->rng);
+            } while (talk_plant_avoid(ctx, i, word));
+        }
+        if (!word) {
+            return -1;
         }
-        /*
-        if (x < format_len - 1) {
-            x++;
+        if (talk_part(parts, parts_max, i, word) < 0) {
+            // We reached the maximum number of parts. Stop processing.
+            break;
+        }
+        if (i) {
+            strbuf_putc(out, ' ');
+        }
+        strbuf_puts(out, word);
+    }
+    return (int) i;
+}
+
+/**
+ * Describe the source of the word in a position of an acronym phrase
+ * @param plan compiled format applied to each character of s
+ * @param s acronym
+ * @param slot position in the phrase
+ * @param pool array receiving the pools (TALK_POOL_MAX)
+ * @return number of pools
+ */
+size_t talk_acronym_pools(const struct Format *plan, const char *s, size_t slot, struct TalkPool *pool) {
+    talk_format_pools(talk_acronym_op(plan, slot), pool);
+    pool->letter = (unsigned char) s[slot];
+    return 1;
+}
+
+/**
+ * Prepare the static buffer of a non-reentrant wrapper
+ * @param sb pointer to string builder
+ */
+static void talk_wrapper_buffer(struct StrBuf *sb) {
+    if (!sb->owned) {
+        strbuf_new(sb, 0);
+    }
+    strbuf_clear(sb);
+}
+
+/**
+ * Produce an output string containing various user-defined types of words
+ *
+ * Not reentrant. See talkf_r.
+ *
+ * @param dict array of dictionary views (indexed by word type)
+ * @param rng pointer to random number generator
+ * @param fmt output format
+ * @param parts array receiving a pointer to each word (NULL=don't record)
+ * @param parts_max maximum number of parts
+ * @return pointer to local storage (don't free it), or NULL if fmt is empty
+ */
+char *talkf(struct DictionaryView dict[], struct Rng *rng, char *fmt, const char **parts, size_t parts_max) {
+    static struct StrBuf sb;
+    struct Talk ctx;
+
+    talk_init(&ctx, dict, rng);
+    talk_wrapper_buffer(&sb);
+    if (talkf_r(&ctx, fmt, &sb, parts, parts_max) < 0) {
+        return NULL;
+    }
+    return sb.data;
+}
+
+char *talk_salad(struct DictionaryView dict[], struct Rng *rng, size_t limit, const char **parts, size_t parts_max) {
+    static struct StrBuf sb;
+    struct Talk ctx;
+
+    talk_init(&ctx, dict, rng);
+    talk_wrapper_buffer(&sb);
+    talk_salad_r(&ctx, limit, &sb, parts, parts_max);
+    return sb.data;
+}
+
+char *talk_heart(struct DictionaryView dict[], struct Rng *rng, size_t word_limit, size_t word_maxlen, const char **parts, size_t parts_max) {
+    static struct StrBuf sb;
+    struct Talk ctx;
+
+    talk_init(&ctx, dict, rng);
+    talk_wrapper_buffer(&sb);
+    talk_heart_r(&ctx, word_limit, word_maxlen, &sb, parts, parts_max);
+    return sb.data;
+}
+
+char *talk_acronym(struct DictionaryView dict[], struct Rng *rng, char *fmt, char *s, const char **parts, size_t parts_max) {
+    static struct StrBuf sb;
+    struct Format plan;
+    struct Talk ctx;
+
+    talk_init(&ctx, dict, rng);
+    talk_wrapper_buffer(&sb);
+    if (format_compile(&plan, fmt && *fmt ? fmt : "x", dict) < 0) {
+        return NULL;
+    }
+    talk_acronym_r(&ctx, &plan, s, &sb, parts, parts_max);
+    format_free(&plan);
+    return sb.data;
+}
+
+/**
+ * Determine whether every character of an acronym begins a word
+ *
+ * @param plan compiled format applied to each character of acronym
+ * @param acronym acronym
+ * @return position of the first character without a word, or -1 if all have words
+ */
+int acronym_valid(const struct Format *plan, const char *acronym) {
+    for (size_t i = 0; acronym[i] != '\0'; i++) {
+        const struct FormatOp *op = talk_acronym_op(plan, i);
+        size_t count;
+
+        if (!op->view) {
+            return (int) i;
+        }
+        index_letter(op->view->dict, op->view->type, acronym[i], &count);
+        if (!count) {
+            return (int) i;
         }
-         */
     }
-    return buf;
+    return -1;
 }
 
-int acronym_safe(struct Dictionary *dict, const char *acronym, const char *pattern, const char *fmt) {
+int acronym_safe(const struct Dictionary *dict, const char *acronym, const char *pattern, const char *fmt) {
     size_t acronym_len;
     size_t fmt_len;
     size_t types_len;
@@ -180,10 +621,12 @@ int acronym_safe(struct Dictionary *dict, const char *acronym, const char *patte
     format_valid = 1;
     if (fmt) {
         format_valid = 0;
-        char *types;
+        char types[WT_VERB + 1];
+        struct StrBuf sb;
         fmt_len = strlen(fmt);
-        types = dictionary_word_formats(dict, pattern);
-        types_len = strlen(types);
+        strbuf_init(&sb, types, sizeof(types));
+        dictionary_word_formats_r(dict, pattern, &sb);
+        types_len = sb.len;
 
         for (size_t x = 0; x < types_len; x++) {
             if (format_valid) break;
@@ -199,18 +642,3 @@ int acronym_safe(struct Dictionary *dict, const char *acronym, const char *patte
 
     return pattern_valid - format_valid == 0;
 }
-
-int format_safe(char *s) {
-    size_t valid;
-    const char *formatter = DEFAULT_FORMAT"x";
-
-    valid = 0;
-    for (size_t i = 0; i < strlen(formatter); i++) {
-        for (size_t x = 0; x < strlen(s); x++) {
-            if (s[x] == formatter[i]) {
-                valid++;
-            }
-        }
-    }
-    return valid == strlen(s);
-}
\ No newline at end of file